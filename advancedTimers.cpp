@@ -1,7 +1,8 @@
 // Headers
 #include <iostream>
 #include <string>
-#include <sstream>
+#include <chrono>
+#include <cstdio>
 #include "SDL.h"
 #include "SDL_image.h"
 #include "SDL_ttf.h"
@@ -11,6 +12,11 @@ int const SCREEN_WIDTH = 640;
 int const SCREEN_HEIGHT = 480;
 int const SCREEN_BPP = 32;
 
+// The characters kept in a glyph atlas
+int const GLYPH_FIRST = 32;
+int const GLYPH_LAST = 126;
+int const GLYPH_COUNT = GLYPH_LAST - GLYPH_FIRST + 1;
+
 // Events
 SDL_Event event;
 
@@ -19,7 +25,6 @@ SDL_Surface *screen;
 SDL_Surface *background;
 SDL_Surface *startStop;
 SDL_Surface *pauseMessage;
-SDL_Surface *seconds;
 
 // Font
 TTF_Font *font;
@@ -46,8 +51,11 @@ class Timer
 	void pause();
 	void unpause();
 
-	// Get the timer's time
-	int get_ticks();
+	// Get the timer's time in milliseconds
+	double get_ticks();
+
+	// Get the timer's time at full resolution
+	std::chrono::nanoseconds get_time();
 
 	// Checks the status of the timer
 	bool is_started();
@@ -55,16 +63,56 @@ class Timer
 
 	private:
 	// The time when the timer startered
-	int startTicks;
+	std::chrono::steady_clock::time_point startTime;
 
 	// The ticks stored when the timer was paused
-	int pausedTicks;
+	std::chrono::nanoseconds pausedTime;
 
 	// The timer status
 	bool paused;
 	bool started;
 };
 
+// Every printable character of a font rendered once into one surface, strings are drawn by blitting from it
+class GlyphAtlas
+{
+  public:
+	// Default constructor
+	GlyphAtlas();
+
+	// Renders the font's characters in the color into the atlas
+	bool build(TTF_Font *font, SDL_Color color);
+
+	// Frees the atlas surface
+	void clear();
+
+	// Gets the width the string takes when drawn
+	int get_width(const char *text);
+
+	// Draws the string with its top left at the offsets
+	void draw(int x, int y, const char *text, SDL_Surface *destination);
+
+	private:
+	// The surface holding the glyphs
+	SDL_Surface *atlas;
+
+	// Where each glyph is in the atlas
+	SDL_Rect clips[GLYPH_COUNT];
+
+	// Where each glyph is drawn from the pen position
+	int xOffset[GLYPH_COUNT];
+	int yOffset[GLYPH_COUNT];
+
+	// How far each glyph moves the pen
+	int advance[GLYPH_COUNT];
+
+	// Gets the glyph used for a character
+	int glyph(char c);
+};
+
+// The atlas used for the timer's time
+GlyphAtlas timeText;
+
 int main(int argc, char *args[] )
 {
 	// Make timer
@@ -138,19 +186,13 @@ int main(int argc, char *args[] )
 		apply_surface((SCREEN_WIDTH - pauseMessage->w)/2, 250, pauseMessage, screen);
 
 		// The timer's time as a string
-		std::stringstream time;
+		char time[32];
 
-		// Convert the timer's time to a string
-		time << "Timer:" << myTimer.get_ticks()/1000.f;
+		// Convert the timer's time to a string, always to the millisecond so the text doesn't change width
+		snprintf(time, sizeof(time), "Timer:%.3f", myTimer.get_ticks()/1000.0);
 
-		// Render the time surface
-		seconds = TTF_RenderText_Solid(font, time.str().c_str(), textColor);
-
-		// Apply the surface
-		apply_surface((SCREEN_WIDTH - seconds->w)/2, 0, seconds, screen);
-
-		// Free the time surface
-		SDL_FreeSurface(seconds);
+		// Draw the time from the glyph atlas
+		timeText.draw((SCREEN_WIDTH - timeText.get_width(time))/2, 0, time, screen);
 
 		// Update the screen
 		if(SDL_Flip(screen) == -1)
@@ -249,6 +291,13 @@ bool load_files()
 	{
 		return false;
 	}
+
+	// Render the glyphs for the timer's time
+	if(timeText.build(font, textColor) == false)
+	{
+		return false;
+	}
+
 	// If everything loaded without error
 	return true;
 }
@@ -259,6 +308,7 @@ void clean_up()
 	SDL_FreeSurface(background);
 	SDL_FreeSurface(startStop);
 	SDL_FreeSurface(pauseMessage);
+	timeText.clear();
 	TTF_CloseFont(font);
 	// Quit TTF and SDL
 	TTF_Quit();
@@ -269,8 +319,8 @@ void clean_up()
 Timer::Timer()
 {
 	// Initialize the variables
-	startTicks = 0;
-	pausedTicks = 0;
+	startTime = std::chrono::steady_clock::time_point();
+	pausedTime = std::chrono::nanoseconds::zero();
 	paused = false;
 	started = false;
 }
@@ -284,7 +334,7 @@ void Timer::start()
 	paused = false;
 
 	// Get the current clock time 
-	startTicks =SDL_GetTicks();	
+	startTime = std::chrono::steady_clock::now();
 }
 
 void Timer::stop()
@@ -297,7 +347,7 @@ void Timer::stop()
 
 }
 
-int Timer::get_ticks()
+std::chrono::nanoseconds Timer::get_time()
 {
 	// If the timer is running
 	if(started == true)
@@ -306,17 +356,23 @@ int Timer::get_ticks()
 		if(paused == true)
 		{
 			// Return the number of ticks when the timer was paused
-			return pausedTicks;
+			return pausedTime;
 		}
 		else
 		{
 			// Return the current time minus the start time
-			return SDL_GetTicks() - startTicks;	
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime);
 		}
 
 	}
 	// If the timer isn't running
-	return 0;
+	return std::chrono::nanoseconds::zero();
+}
+
+double Timer::get_ticks()
+{
+	// Convert the time to fractional milliseconds
+	return std::chrono::duration<double, std::milli>(get_time()).count();
 }
 
 void Timer::pause()
@@ -328,7 +384,7 @@ void Timer::pause()
 		paused = true;
 
 		// Calculate the paused ticks
-		pausedTicks = SDL_GetTicks() - startTicks;
+		pausedTime = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime);
 	}
 }
 
@@ -341,10 +397,10 @@ void Timer::unpause()
 		paused = false;
 
 		// Reset the starting ticks
-		startTicks = SDL_GetTicks() - pausedTicks;
+		startTime = std::chrono::steady_clock::now() - pausedTime;
 
 		// Reset the paused ticks
-		pausedTicks = 0;
+		pausedTime = std::chrono::nanoseconds::zero();
 	}
 }
 
@@ -357,3 +413,144 @@ bool Timer::is_paused()
 {
 	return paused;
 }
+
+GlyphAtlas::GlyphAtlas()
+{
+	// The atlas is empty until it's built
+	atlas = NULL;
+}
+
+bool GlyphAtlas::build(TTF_Font *font, SDL_Color color)
+{
+	// The glyphs before they're put in the atlas
+	SDL_Surface *glyphs[GLYPH_COUNT];
+
+	// The size of the atlas
+	int width = 0;
+	int height = 0;
+
+	// The height of the font above the baseline
+	int ascent = TTF_FontAscent(font);
+
+	// Render each glyph and lay it out left to right
+	for(int i = 0; i < GLYPH_COUNT; i++)
+	{
+		int minX, maxX, minY, maxY;
+
+		// Get where the glyph sits and how far it moves the pen
+		if(TTF_GlyphMetrics(font, GLYPH_FIRST + i, &minX, &maxX, &minY, &maxY, &advance[i]) == -1)
+		{
+			minX = 0;
+			maxY = 0;
+			advance[i] = 0;
+		}
+		xOffset[i] = minX;
+		yOffset[i] = ascent - maxY;
+
+		// Blank glyphs like space have nothing to render
+		glyphs[i] = TTF_RenderGlyph_Solid(font, GLYPH_FIRST + i, color);
+
+		clips[i].x = width;
+		clips[i].y = 0;
+		clips[i].w = 0;
+		clips[i].h = 0;
+
+		if(glyphs[i] != NULL)
+		{
+			clips[i].w = glyphs[i]->w;
+			clips[i].h = glyphs[i]->h;
+
+			// Leave a gap so glyphs don't bleed into each other
+			width += glyphs[i]->w + 1;
+
+			if(glyphs[i]->h > height)
+			{
+				height = glyphs[i]->h;
+			}
+		}
+	}
+
+	// Make the atlas in the screen's format so drawing from it doesn't convert
+	SDL_Surface *packed = SDL_CreateRGBSurface(SDL_SWSURFACE, width, height, SCREEN_BPP, 0, 0, 0, 0);
+	if(packed != NULL)
+	{
+		atlas = SDL_DisplayFormat(packed);
+		SDL_FreeSurface(packed);
+	}
+
+	if(atlas != NULL)
+	{
+		// Fill the atlas with the color key so only the glyphs show
+		Uint32 key = SDL_MapRGB(atlas->format, 0, 0xFF, 0xFF);
+		SDL_FillRect(atlas, NULL, key);
+
+		// Copy the glyphs in
+		for(int i = 0; i < GLYPH_COUNT; i++)
+		{
+			if(glyphs[i] != NULL)
+			{
+				SDL_Rect offset;
+				offset.x = clips[i].x;
+				offset.y = 0;
+				SDL_BlitSurface(glyphs[i], NULL, atlas, &offset);
+			}
+		}
+
+		SDL_SetColorKey(atlas, SDL_SRCCOLORKEY | SDL_RLEACCEL, key);
+	}
+
+	// Free the glyph surfaces
+	for(int i = 0; i < GLYPH_COUNT; i++)
+	{
+		SDL_FreeSurface(glyphs[i]);
+	}
+
+	return atlas != NULL;
+}
+
+void GlyphAtlas::clear()
+{
+	SDL_FreeSurface(atlas);
+	atlas = NULL;
+}
+
+int GlyphAtlas::glyph(char c)
+{
+	// Characters outside the atlas show as a question mark
+	if((c < GLYPH_FIRST) || (c > GLYPH_LAST))
+	{
+		c = '?';
+	}
+	return c - GLYPH_FIRST;
+}
+
+int GlyphAtlas::get_width(const char *text)
+{
+	// Add up how far each glyph moves the pen
+	int width = 0;
+	for(const char *c = text; *c != '\0'; c++)
+	{
+		width += advance[glyph(*c)];
+	}
+	return width;
+}
+
+void GlyphAtlas::draw(int x, int y, const char *text, SDL_Surface *destination)
+{
+	// Go through the string moving the pen along
+	for(const char *c = text; *c != '\0'; c++)
+	{
+		int i = glyph(*c);
+
+		// Blit the glyph out of the atlas
+		if(clips[i].w > 0)
+		{
+			SDL_Rect offset;
+			offset.x = x + xOffset[i];
+			offset.y = y + yOffset[i];
+			SDL_BlitSurface(atlas, &clips[i], destination, &offset);
+		}
+
+		x += advance[i];
+	}
+}
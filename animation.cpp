@@ -1,9 +1,28 @@
 // WIP
 
 #include <string>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <cmath>
 #include "SDL.h"
 #include "SDL_Image.h"
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 // Constants
 const int SCREEN_WIDTH = 640;
 const int SCREEN_HEIGHT = 480;
@@ -15,28 +34,128 @@ const int FOO_HEIGHT = 205;
 const int FOO_LEFT = 1;
 const int FOO_RIGHT = 0;
 
+// The layer the stick figure is drawn on
+const int FOO_LAYER = 0;
+
 const int FRAMES_PER_SECOND = 10;
 
+// How long before a deadline the frame pacer stops sleeping and spins, in milliseconds
+const double PACER_SPIN_TIME = 2.0;
+
+// How an animation carries on past its last frame: starting over, stopping on it, or going back the way it came
+const int ANIM_LOOP = 0;
+const int ANIM_ONCE = 1;
+const int ANIM_PING_PONG = 2;
+
+// The stick figure's animations, in the order they're added
+const int FOO_STAND = 0;
+const int FOO_WALK = 1;
+
+// What changes the stick figure's animation
+const int FOO_STARTED = 0;
+const int FOO_STOPPED = 1;
+
+// How long each frame of the walk is shown, in milliseconds
+const double FOO_FRAME_TIME = 100;
+
+// The number of clips in a packed stick figure sheet, all facing right, the left facing ones are mirrored from them
+const unsigned int FOO_CLIPS = 4;
+
+// The first bytes of a packed sprite file
+const char SPRITE_MAGIC[4] = {'S', 'P', 'R', '1'};
+
 // Events
 SDL_Event event;
 
 // Rects
 SDL_Rect clipsRight[4];
-SDL_Rect clipsLeft[4];
 
 // Surfaces
 SDL_Surface *screen = NULL;
 SDL_Surface *foo = NULL;
 
+// The surface each clip is on
+SDL_Surface *sheetsRight[4];
+
 // Prototypes
 SDL_Surface *load_image(std::string filename);
 void apply_surface(int x, int y, SDL_Surface *source, SDL_Surface *destination, SDL_Rect *clip = NULL);
 void set_clips() ;
+void set_animations();
 bool init();
 bool load_files();
 void clean_up();
 
 // Classes
+
+// Where one thing is in its animation, kept small so many of them can be updated in one loop
+struct AnimationState
+{
+	// The animation and the frame in it
+	int clip;
+	int index;
+
+	// How long the frame has been shown, in milliseconds
+	double time;
+
+	// Which way a ping pong animation is going, 1 or -1
+	int step;
+};
+
+// Animations as sequences of sheet frames with their own timings, and what sets off a change from one to another
+class AnimationSet
+{
+	public:
+		// Adds an animation played the given way, returns its number
+		// A once through animation goes on to the next one when it's done, or stops on its last frame if next is -1
+		int add_clip(int mode, int next = -1);
+
+		// Adds a frame shown for the given milliseconds to the end of an animation
+		void add_frame(int clip, int frame, double duration);
+
+		// Says to change from one animation to another when the trigger happens
+		void add_transition(int from, int trigger, int to);
+
+		// Starts an animation from its first frame, unless it's already playing
+		void play(AnimationState &state, int clip);
+
+		// Changes the animation if the current one has a transition for the trigger
+		void trigger(AnimationState &state, int trigger);
+
+		// Moves the animation on by the elapsed milliseconds
+		void update(AnimationState &state, double elapsed);
+
+		// Gets the sheet frame to show
+		int get_frame(const AnimationState &state);
+
+		// Gets whether a once through animation has stopped on its last frame
+		bool is_done(const AnimationState &state);
+
+	private:
+		// An animation
+		struct Clip
+		{
+			int mode;
+			int next;
+
+			// The sheet frames and how long each is shown
+			std::vector<int> frames;
+			std::vector<double> durations;
+
+			// How long it takes to come back round to the same frame, for looping animations
+			double cycle;
+
+			// The animation each trigger changes to
+			std::map<int, int> transitions;
+		};
+
+		// The animations
+		std::vector<Clip> clips;
+};
+
+// The stick figure's animations
+AnimationSet fooAnimations;
+
 class Foo 
 { 
  	private: 
@@ -46,10 +165,10 @@ class Foo
 	    	// Rate of movement 
 	    	int velocity; 
 	    
-	   	// Its current frame 
-	    	int frame; 
+	   	// Where it is in its animation
+	    	AnimationState animation; 
 	    
-	  	// Its animation status 
+	  	// Which way it's facing 
 	    	int status; 
 	
 	    	// Jump
@@ -65,6 +184,9 @@ class Foo
 	    
 	    	// Moves the stick figure 
 	    	void move(); 
+
+	    	// Moves the animation on by the elapsed milliseconds
+	    	void animate(double elapsed);
 	    
 	    	// Shows the stick figure 
 	    	void show(); 
@@ -73,21 +195,195 @@ class Foo
 class Timer
 {
 	private:
-  		int pausedTicks;
-		int startTicks;
+  		std::chrono::nanoseconds pausedTime;
+		std::chrono::steady_clock::time_point startTime;
 		bool started;
 		bool paused;
 	public:
 		Timer();
 		bool is_started();
 		bool is_paused();
-		int get_ticks();
+		double get_ticks();
+		std::chrono::nanoseconds get_time();
 		void start();
 		void stop();
 		void pause();
 		void unpause();
 };
 
+// Holds frames to a fixed rate against a running deadline
+class FramePacer
+{
+	public:
+		// Sets the frame rate to pace to
+		FramePacer(int framesPerSecond);
+
+		// Sets the first deadline one frame from now
+		void start();
+
+		// Waits for the current deadline and moves it on by one frame
+		void wait();
+
+		// Gets the number of deadlines that had already passed when waited on
+		int get_missed();
+
+	private:
+		// The time since pacing started
+		Timer clock;
+
+		// The length of a frame in milliseconds
+		double frameLength;
+
+		// When the current frame should end
+		double deadline;
+
+		// The number of missed deadlines
+		int missed;
+};
+
+// Sprites queued for the frame and drawn together, sorted by layer then source surface
+class SpriteBatch
+{
+	public:
+		// Queues the clip of the source to be drawn at the offsets, higher layers are drawn over lower ones
+		void add(SDL_Surface *source, SDL_Rect *clip, int x, int y, int layer);
+
+		// Draws the queued sprites inside the destination's clip rect and empties the batch
+		void flush(SDL_Surface *destination);
+
+	private:
+		// A queued sprite
+		struct Sprite
+		{
+			SDL_Surface *source;
+			SDL_Rect clip;
+			int x, y;
+			int layer;
+		};
+
+		// The sprites queued this frame
+		std::vector<Sprite> sprites;
+
+		// Orders sprites by layer, then by source so blits from one surface run together
+		static bool draw_order(const Sprite &a, const Sprite &b);
+};
+
+// The header at the start of a packed sprite file from spritePacker, followed by the clips as four Sint32s each, then the pixels
+struct SpriteHeader
+{
+	char magic[4];
+	Uint32 w, h;
+	Uint32 pitch;
+	Uint32 bpp;
+	Uint32 rMask, gMask, bMask, aMask;
+	Uint32 colorKey;
+	Uint32 clipCount;
+	Uint32 pixelOffset;
+};
+
+// A packed sprite file mapped into memory, its pixels are used as a surface where they lie
+class SpriteFile
+{
+	public:
+		// Initializes the variables
+		SpriteFile();
+
+		// Maps the file, returns false if it can't be used as is with the screen's format
+		bool open(std::string filename);
+
+		// Frees the surface and unmaps the file
+		void close();
+
+		// Gets the surface over the file's pixels
+		SDL_Surface *get_surface();
+
+		// Gets the clips baked into the file, checked to be on the image when it was opened, an empty clip if there isn't one
+		unsigned int get_clip_count();
+		SDL_Rect get_clip(int i);
+
+	private:
+		// The mapped file
+		void *data;
+		size_t size;
+
+		// The surface over the pixels
+		SDL_Surface *surface;
+
+		// Maps the whole file copy on write
+		bool map_file(std::string filename);
+
+		// Unmaps the file
+		void unmap_file();
+};
+
+// The sprites drawn this frame
+SpriteBatch sprites;
+
+// The packed stick figure sheet
+SpriteFile fooFile;
+
+// Sprites packed onto atlas pages by atlasPacker, looked up by name
+class Atlas
+{
+	public:
+		// Loads the index and its pages, returns false if any of it couldn't be loaded
+		bool load(std::string indexFile);
+
+		// Frees the pages
+		void clear();
+
+		// Gets the page and clip of the named sprite, returns false if there's no such sprite
+		bool find(std::string name, SDL_Surface *&page, SDL_Rect &clip);
+
+	private:
+		// Where a sprite is
+		struct Entry
+		{
+			unsigned int page;
+			SDL_Rect clip;
+		};
+
+		// The sprites by name
+		std::map<std::string, Entry> entries;
+
+		// The pages
+		std::vector<SDL_Surface *> pages;
+};
+
+// The sprite atlas
+Atlas atlas;
+
+// Left to right mirrored copies of clips, each made the first time it's asked for and kept
+class MirrorCache
+{
+	public:
+		// Gets the mirrored copy of the clip of the sheet, it's drawn whole
+		// NULL if the clip isn't all on the sheet, the copy isn't clipped like a blit is
+		SDL_Surface *get(SDL_Surface *sheet, SDL_Rect *clip);
+
+		// Frees the copies
+		void clear();
+
+	private:
+		// What a copy is looked up by
+		struct Key
+		{
+			SDL_Surface *sheet;
+			int x, y, w, h;
+
+			bool operator<(const Key &other) const;
+		};
+
+		// The copies
+		std::map<Key, SDL_Surface *> mirrors;
+
+		// Copies the clip of the source into the destination with each row reversed
+		static void mirror_rows(SDL_Surface *source, SDL_Rect *clip, SDL_Surface *destination);
+};
+
+// The mirrored frames
+MirrorCache mirrors;
+
 int main(int argc, char *args[])
 {
 	bool quit = false;
@@ -102,21 +398,25 @@ int main(int argc, char *args[])
 		return 1;
 	}
 
-	// Set the sprite sheet clips
-	set_clips();
+	// Set up how the clips are played
+	set_animations();
 
 	// The frame rate regulator
-	Timer fps;
+	FramePacer fps(FRAMES_PER_SECOND);
 
 	// Make the stick figure
 	Foo walk;
 
+	// The time since the last frame
+	Timer delta;
+
+	// Start pacing frames
+	fps.start();
+	delta.start();
+
 	// While the user hasn't quit
 	while(quit == false)
 	{
-		// Start the frame timer
-		fps.start();
-
 		// While there's events to handle
 		while(SDL_PollEvent(&event))
 		{
@@ -134,12 +434,19 @@ int main(int argc, char *args[])
 		// Move the stick figure
 		walk.move();
 
+		// Animate it by the time that's passed, however long the frame took
+		walk.animate(delta.get_ticks());
+		delta.start();
+
 		// Fill the screen white
 		SDL_FillRect(screen, &screen->clip_rect, SDL_MapRGB(screen->format, 0xFF, 0xFF, 0xFF));
 
 		// Show the stick figure on screen
 		walk.show();
 
+		// Draw the queued sprites
+		sprites.flush(screen);
+
 		// Update the screen
 		if(SDL_Flip(screen) == -1)
 		{
@@ -147,10 +454,7 @@ int main(int argc, char *args[])
 		}
 
 		// Cap the frame rate
-		if(fps.get_ticks() < 1000 / FRAMES_PER_SECOND)
-		{
-			SDL_Delay((1000 / FRAMES_PER_SECOND) - fps.get_ticks());
-		}
+		fps.wait();
 	}
 
 	clean_up();
@@ -209,26 +513,24 @@ void set_clips()
 	clipsRight[3].y = 0; 
 	clipsRight[3].w = FOO_WIDTH; 
 	clipsRight[3].h = FOO_HEIGHT; 
+}
 
-	clipsLeft[0].x = 0; 
-	clipsLeft[0].y = FOO_HEIGHT; 
-	clipsLeft[0].w = FOO_WIDTH; 
-	clipsLeft[0].h = FOO_HEIGHT; 
-
-	clipsLeft[1].x = FOO_WIDTH; 
-	clipsLeft[1].y = FOO_HEIGHT; 
-	clipsLeft[1].w = FOO_WIDTH; 
-	clipsLeft[1].h = FOO_HEIGHT; 
+void set_animations()
+{
+	// Standing is the first frame held, the order matches FOO_STAND and FOO_WALK
+	fooAnimations.add_clip(ANIM_ONCE);
+	fooAnimations.add_frame(FOO_STAND, 0, FOO_FRAME_TIME);
 
-	clipsLeft[2].x = FOO_WIDTH * 2; 
-	clipsLeft[2].y = FOO_HEIGHT;
-	clipsLeft[2].w = FOO_WIDTH; 
-	clipsLeft[2].h = FOO_HEIGHT;
+	// Walking runs through the whole row
+	fooAnimations.add_clip(ANIM_LOOP);
+	for(int i = 0; i < 4; i++)
+	{
+		fooAnimations.add_frame(FOO_WALK, i, FOO_FRAME_TIME);
+	}
 
-	clipsLeft[3].x = FOO_WIDTH * 3;
-	clipsLeft[3].y = FOO_HEIGHT; 
-	clipsLeft[3].w = FOO_WIDTH; 
-	clipsLeft[3].h = FOO_HEIGHT; 
+	// Walk while moving and stand when stopped
+	fooAnimations.add_transition(FOO_STAND, FOO_STARTED, FOO_WALK);
+	fooAnimations.add_transition(FOO_WALK, FOO_STOPPED, FOO_STAND);
 }
 
 bool init()
@@ -253,25 +555,83 @@ bool init()
 
 bool load_files()
 {
-	foo = load_image("foo.png");
-	if(foo == NULL)
+	// Use the atlas if the stick figure was packed into one, as foo0 to foo3
+	if(atlas.load("atlas.txt") == true)
 	{
-		return false;
+		bool found = true;
+		for(int i = 0; i < 4; i++)
+		{
+			std::stringstream name;
+			name << "foo" << i;
+
+			if(atlas.find(name.str(), sheetsRight[i], clipsRight[i]) == false)
+			{
+				found = false;
+			}
+		}
+
+		if(found == true)
+		{
+			return true;
+		}
+		atlas.clear();
+	}
+
+	// Use the packed sheet if there is one, its clips come with it
+	if((fooFile.open("foo.spr") == true) && (fooFile.get_clip_count() == FOO_CLIPS))
+	{
+		foo = fooFile.get_surface();
+		for(int i = 0; i < 4; i++)
+		{
+			clipsRight[i] = fooFile.get_clip(i);
+		}
+	}
+	else
+	{
+		fooFile.close();
+
+		// Otherwise decode the image
+		foo = load_image("foo.png");
+		if(foo == NULL)
+		{
+			return false;
+		}
+
+		// Set the sprite sheet clips
+		set_clips();
+	}
+
+	// Every clip is on the one sheet
+	for(int i = 0; i < 4; i++)
+	{
+		sheetsRight[i] = foo;
 	}
+
 	return true;
 }
 
 void clean_up()
 {
-	SDL_FreeSurface(foo);
+	mirrors.clear();
+	atlas.clear();
+
+	// The packed sheet is freed with its file
+	if(foo == fooFile.get_surface())
+	{
+		fooFile.close();
+	}
+	else
+	{
+		SDL_FreeSurface(foo);
+	}
 	SDL_Quit();
 }
 
 // Timer class definitions
 Timer::Timer()
 {
-	pausedTicks = 0;
-	startTicks = 0;
+	pausedTime = std::chrono::nanoseconds::zero();
+	startTime = std::chrono::steady_clock::time_point();
 	started = false;
 	paused = false;
 }
@@ -286,20 +646,25 @@ bool Timer::is_paused()
 	return paused;
 }
 
-int Timer::get_ticks()
+std::chrono::nanoseconds Timer::get_time()
 {
 	if(started == true)
 	{
 		if(paused == true)
 		{
-			return pausedTicks;
+			return pausedTime;
 		}
 		else
 		{
-			return SDL_GetTicks() - startTicks;
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime);
 		}
 	}
-	return 0;
+	return std::chrono::nanoseconds::zero();
+}
+
+double Timer::get_ticks()
+{
+	return std::chrono::duration<double, std::milli>(get_time()).count();
 }
 
 void Timer::start()
@@ -307,7 +672,7 @@ void Timer::start()
 	started = true;
 	paused = false;
 
-	startTicks = SDL_GetTicks();
+	startTime = std::chrono::steady_clock::now();
 }
 
 void Timer::stop()
@@ -321,7 +686,7 @@ void Timer::pause()
 	if((started == true) && (paused == false))
 	{
 		paused = true;
-		pausedTicks = SDL_GetTicks() - startTicks;
+		pausedTime = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime);
 	}
 }
 
@@ -330,8 +695,8 @@ void Timer::unpause()
 	if(paused == true)
 	{
 		paused = false;
-		startTicks = SDL_GetTicks() - pausedTicks;
-		pausedTicks = 0;
+		startTime = std::chrono::steady_clock::now() - pausedTime;
+		pausedTime = std::chrono::nanoseconds::zero();
 	}
 }
 
@@ -344,8 +709,9 @@ Foo::Foo()
 	yAxis = 0;
 
 	// Init animation variables
-	frame = 0;
 	status = FOO_RIGHT;
+	animation.clip = -1;
+	fooAnimations.play(animation, FOO_STAND);
 }
 
 void Foo::move()
@@ -358,59 +724,56 @@ void Foo::move()
 	{
 		offSet -= velocity;
 	}
+
+	// Fall back down from a jump
+	if(yAxis > 0)
+	{
+		yAxis -= FOO_HEIGHT / 5;
+	}
 }
 
-void Foo::show()
+void Foo::animate(double elapsed)
 {
-	// If Foo is moving left
+	// Face the way it's moving
 	if(velocity < 0)
 	{
-		// Set the animation to left
 		status = FOO_LEFT;
-
-		// Move to next frame
-		frame++;
 	}
-
-	// If Foo is moving right
 	else if(velocity > 0)
 	{
-		// Set the animation to right
 		status = FOO_RIGHT;
-
-		// Move to next frame
-		frame++;
 	}
 
-	// If Foo is standing
-	else
+	// Walk while moving, stand while not
+	if(velocity != 0)
 	{
-		// Restart the animation
-		frame = 0;
+		fooAnimations.trigger(animation, FOO_STARTED);
 	}
-
-	// Loop the animation
-	if(frame >= 4)
+	else
 	{
-		frame = 0;
+		fooAnimations.trigger(animation, FOO_STOPPED);
 	}
 
+	fooAnimations.update(animation, elapsed);
+}
+
+void Foo::show()
+{
+	int frame = fooAnimations.get_frame(animation);
+
 	// Shows the stick figure
 	if(status == FOO_RIGHT)
 	{
-		apply_surface(offSet, SCREEN_HEIGHT - FOO_HEIGHT - yAxis, foo, screen, &clipsRight[frame]);
-		if(yAxis > 0)
-		{
-			yAxis -= FOO_HEIGHT / 5;
-		}
+		sprites.add(sheetsRight[frame], &clipsRight[frame], offSet, SCREEN_HEIGHT - FOO_HEIGHT - yAxis, FOO_LAYER);
 	}
 	
 	else if(status == FOO_LEFT)
 	{
-		apply_surface(offSet, SCREEN_HEIGHT - FOO_HEIGHT - yAxis, foo, screen, &clipsLeft[frame]);
-		if(yAxis > 0)
+		// Facing left is facing right mirrored
+		SDL_Surface *mirrored = mirrors.get(sheetsRight[frame], &clipsRight[frame]);
+		if(mirrored != NULL)
 		{
-			yAxis -= FOO_HEIGHT / 5;
+			sprites.add(mirrored, NULL, offSet, SCREEN_HEIGHT - FOO_HEIGHT - yAxis, FOO_LAYER);
 		}
 	}
 }
@@ -435,3 +798,710 @@ void Foo::handle_events()
 		}
 	}
 }
+
+FramePacer::FramePacer(int framesPerSecond)
+{
+	// Initialize the variables
+	frameLength = 1000.0 / framesPerSecond;
+	deadline = 0;
+	missed = 0;
+}
+
+void FramePacer::start()
+{
+	// Start the clock with the first frame due one frame from now
+	clock.start();
+	deadline = frameLength;
+}
+
+void FramePacer::wait()
+{
+	double now = clock.get_ticks();
+
+	// If the frame ran past its deadline
+	if(now > deadline)
+	{
+		missed++;
+
+		// If it's a whole frame behind, start over from now instead of rushing to catch up
+		if(now - deadline >= frameLength)
+		{
+			deadline = now;
+		}
+	}
+	else
+	{
+		// Sleep through most of the wait, the OS may wake us late
+		if(deadline - now > PACER_SPIN_TIME)
+		{
+			SDL_Delay((Uint32)(deadline - now - PACER_SPIN_TIME));
+		}
+
+		// Spin out the rest against the clock
+		while(clock.get_ticks() < deadline)
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	// The next deadline is one frame after this one, so lateness doesn't add up
+	deadline += frameLength;
+}
+
+int FramePacer::get_missed()
+{
+	return missed;
+}
+
+void SpriteBatch::add(SDL_Surface *source, SDL_Rect *clip, int x, int y, int layer)
+{
+	Sprite sprite;
+	sprite.source = source;
+	sprite.x = x;
+	sprite.y = y;
+	sprite.layer = layer;
+
+	// No clip means the whole surface
+	int left = 0;
+	int top = 0;
+	int right = source->w;
+	int bottom = source->h;
+
+	// Keep the clip inside the source so flush can skip SDL's checks
+	if(clip != NULL)
+	{
+		left = std::max((int)clip->x, 0);
+		top = std::max((int)clip->y, 0);
+		right = std::min(clip->x + clip->w, source->w);
+		bottom = std::min(clip->y + clip->h, source->h);
+
+		sprite.x += left - clip->x;
+		sprite.y += top - clip->y;
+	}
+
+	// If nothing of the clip is left
+	if((right <= left) || (bottom <= top))
+	{
+		return;
+	}
+
+	sprite.clip.x = left;
+	sprite.clip.y = top;
+	sprite.clip.w = right - left;
+	sprite.clip.h = bottom - top;
+
+	sprites.push_back(sprite);
+}
+
+bool SpriteBatch::draw_order(const Sprite &a, const Sprite &b)
+{
+	if(a.layer != b.layer)
+	{
+		return a.layer < b.layer;
+	}
+	// Then by source, std::less gives pointers to separate surfaces a set order where < doesn't
+	return std::less<SDL_Surface *>()(a.source, b.source);
+}
+
+void SpriteBatch::flush(SDL_Surface *destination)
+{
+	// Sort the sprites, keeping the order they were added in within a layer and source
+	std::stable_sort(sprites.begin(), sprites.end(), draw_order);
+
+	// The area that can be drawn to
+	SDL_Rect bounds = destination->clip_rect;
+
+	for(unsigned int i = 0; i < sprites.size(); i++)
+	{
+		Sprite &sprite = sprites[i];
+
+		// Clip the sprite to the drawable area
+		int left = std::max(sprite.x, (int)bounds.x);
+		int top = std::max(sprite.y, (int)bounds.y);
+		int right = std::min(sprite.x + sprite.clip.w, bounds.x + bounds.w);
+		int bottom = std::min(sprite.y + sprite.clip.h, bounds.y + bounds.h);
+
+		// If the sprite is off the drawable area, cull it
+		if((right <= left) || (bottom <= top))
+		{
+			continue;
+		}
+
+		// The part of the source that shows
+		SDL_Rect source;
+		source.x = sprite.clip.x + left - sprite.x;
+		source.y = sprite.clip.y + top - sprite.y;
+		source.w = right - left;
+		source.h = bottom - top;
+
+		// Where it shows
+		SDL_Rect offset;
+		offset.x = left;
+		offset.y = top;
+		offset.w = source.w;
+		offset.h = source.h;
+
+		// Both rects are already clipped so the checks in SDL_BlitSurface can be skipped
+		SDL_LowerBlit(sprite.source, &source, destination, &offset);
+	}
+
+	sprites.clear();
+}
+
+SpriteFile::SpriteFile()
+{
+	data = NULL;
+	size = 0;
+	surface = NULL;
+}
+
+bool SpriteFile::map_file(std::string filename)
+{
+#ifdef _WIN32
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+	if(GetFileSizeEx(file, &fileSize) == 0)
+	{
+		CloseHandle(file);
+		return false;
+	}
+	size = (size_t)fileSize.QuadPart;
+
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+	CloseHandle(file);
+	if(mapping == NULL)
+	{
+		return false;
+	}
+
+	// The view keeps the mapping alive
+	data = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+	CloseHandle(mapping);
+#else
+	int file = ::open(filename.c_str(), O_RDONLY);
+	if(file == -1)
+	{
+		return false;
+	}
+
+	struct stat info;
+	if((fstat(file, &info) == -1) || (info.st_size == 0))
+	{
+		::close(file);
+		return false;
+	}
+	size = info.st_size;
+
+	// The mapping keeps the file alive
+	data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+	::close(file);
+	if(data == MAP_FAILED)
+	{
+		data = NULL;
+	}
+#endif
+
+	return data != NULL;
+}
+
+void SpriteFile::unmap_file()
+{
+	if(data != NULL)
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(data);
+#else
+		munmap(data, size);
+#endif
+	}
+	data = NULL;
+	size = 0;
+}
+
+bool SpriteFile::open(std::string filename)
+{
+	if(map_file(filename) == false)
+	{
+		return false;
+	}
+
+	// If the file is too small to be a sprite file
+	if(size < sizeof(SpriteHeader))
+	{
+		unmap_file();
+		return false;
+	}
+
+	SpriteHeader *header = (SpriteHeader *)data;
+	SDL_PixelFormat *format = screen->format;
+
+	// The clips and pixels have to fit in the file, in that order
+	Uint64 clipsEnd = sizeof(SpriteHeader) + (Uint64)header->clipCount * 4 * sizeof(Sint32);
+	Uint64 pixelsEnd = (Uint64)header->pixelOffset + (Uint64)header->pitch * header->h;
+
+	// If it isn't a sprite file, doesn't fit, or was packed for a different screen format
+	if((memcmp(header->magic, SPRITE_MAGIC, sizeof(header->magic)) != 0) || (clipsEnd > header->pixelOffset) || (pixelsEnd > size) ||
+		(header->bpp != format->BitsPerPixel) || (header->rMask != format->Rmask) || (header->gMask != format->Gmask) || (header->bMask != format->Bmask))
+	{
+		unmap_file();
+		return false;
+	}
+
+	// The rows can't overlap, and have to fit the Uint16 pitch of a surface
+	if((header->w == 0) || (header->h == 0) || ((Uint64)header->pitch < (Uint64)header->w * (header->bpp / 8)) || (header->pitch > 0xFFFF))
+	{
+		unmap_file();
+		return false;
+	}
+
+	// Each clip has to be on the image, it's used as is
+	Sint32 *clips = (Sint32 *)((Uint8 *)data + sizeof(SpriteHeader));
+	for(Uint32 i = 0; i < header->clipCount; i++)
+	{
+		Sint64 x = clips[i * 4], y = clips[i * 4 + 1], w = clips[i * 4 + 2], h = clips[i * 4 + 3];
+		if((x < 0) || (y < 0) || (w <= 0) || (h <= 0) || (x + w > header->w) || (y + h > header->h))
+		{
+			unmap_file();
+			return false;
+		}
+	}
+
+	// Wrap the pixels where they are
+	surface = SDL_CreateRGBSurfaceFrom((Uint8 *)data + header->pixelOffset, header->w, header->h, header->bpp, header->pitch,
+		header->rMask, header->gMask, header->bMask, header->aMask);
+	if(surface == NULL)
+	{
+		unmap_file();
+		return false;
+	}
+
+	// No RLE, that would copy the pixels out of the file
+	SDL_SetColorKey(surface, SDL_SRCCOLORKEY, header->colorKey);
+
+	return true;
+}
+
+void SpriteFile::close()
+{
+	// The surface doesn't own its pixels, free it before they go
+	SDL_FreeSurface(surface);
+	surface = NULL;
+
+	unmap_file();
+}
+
+SDL_Surface *SpriteFile::get_surface()
+{
+	return surface;
+}
+
+unsigned int SpriteFile::get_clip_count()
+{
+	if(surface == NULL)
+	{
+		return 0;
+	}
+	return ((SpriteHeader *)data)->clipCount;
+}
+
+SDL_Rect SpriteFile::get_clip(int i)
+{
+	// If there's no clip there
+	if((i < 0) || ((unsigned int)i >= get_clip_count()))
+	{
+		SDL_Rect none = {0, 0, 0, 0};
+		return none;
+	}
+
+	// The clips come right after the header
+	Sint32 *values = (Sint32 *)((Uint8 *)data + sizeof(SpriteHeader)) + i * 4;
+
+	SDL_Rect clip;
+	clip.x = values[0];
+	clip.y = values[1];
+	clip.w = values[2];
+	clip.h = values[3];
+	return clip;
+}
+
+bool Atlas::load(std::string indexFile)
+{
+	std::ifstream index(indexFile.c_str());
+	if(index.fail() == true)
+	{
+		return false;
+	}
+
+	// The pages are named relative to the index
+	std::string folder = "";
+	size_t slash = indexFile.find_last_of("/\\");
+	if(slash != std::string::npos)
+	{
+		folder = indexFile.substr(0, slash + 1);
+	}
+
+	std::string word;
+	while(index >> word)
+	{
+		// A page to load
+		if(word == "page")
+		{
+			std::string file;
+			index >> file;
+
+			SDL_Surface *page = load_image(folder + file);
+			if(page == NULL)
+			{
+				clear();
+				return false;
+			}
+			pages.push_back(page);
+		}
+		// A sprite's name, page and clip
+		else
+		{
+			Entry entry;
+			int x, y, w, h;
+			index >> entry.page >> x >> y >> w >> h;
+
+			if((index.fail() == true) || (entry.page >= pages.size()))
+			{
+				clear();
+				return false;
+			}
+
+			// The clip has to be on its page, it's used as is
+			SDL_Surface *page = pages[entry.page];
+			if((x < 0) || (y < 0) || (w <= 0) || (h <= 0) || ((Sint64)x + w > page->w) || ((Sint64)y + h > page->h))
+			{
+				clear();
+				return false;
+			}
+
+			entry.clip.x = x;
+			entry.clip.y = y;
+			entry.clip.w = w;
+			entry.clip.h = h;
+			entries[word] = entry;
+		}
+	}
+
+	return pages.empty() == false;
+}
+
+void Atlas::clear()
+{
+	for(unsigned int i = 0; i < pages.size(); i++)
+	{
+		SDL_FreeSurface(pages[i]);
+	}
+	pages.clear();
+	entries.clear();
+}
+
+bool Atlas::find(std::string name, SDL_Surface *&page, SDL_Rect &clip)
+{
+	std::map<std::string, Entry>::iterator found = entries.find(name);
+	if(found == entries.end())
+	{
+		return false;
+	}
+
+	page = pages[found->second.page];
+	clip = found->second.clip;
+	return true;
+}
+
+bool MirrorCache::Key::operator<(const Key &other) const
+{
+	if(sheet != other.sheet)
+	{
+		return sheet < other.sheet;
+	}
+	if(x != other.x)
+	{
+		return x < other.x;
+	}
+	if(y != other.y)
+	{
+		return y < other.y;
+	}
+	if(w != other.w)
+	{
+		return w < other.w;
+	}
+	return h < other.h;
+}
+
+SDL_Surface *MirrorCache::get(SDL_Surface *sheet, SDL_Rect *clip)
+{
+	// If the clip is empty or runs off the sheet
+	if((clip->x < 0) || (clip->y < 0) || (clip->w == 0) || (clip->h == 0) || (clip->x + clip->w > sheet->w) || (clip->y + clip->h > sheet->h))
+	{
+		return NULL;
+	}
+
+	Key key;
+	key.sheet = sheet;
+	key.x = clip->x;
+	key.y = clip->y;
+	key.w = clip->w;
+	key.h = clip->h;
+
+	// If it's been mirrored already
+	std::map<Key, SDL_Surface *>::iterator found = mirrors.find(key);
+	if(found != mirrors.end())
+	{
+		return found->second;
+	}
+
+	// Make a surface just big enough in the sheet's format
+	SDL_PixelFormat *format = sheet->format;
+	SDL_Surface *mirrored = SDL_CreateRGBSurface(SDL_SWSURFACE, clip->w, clip->h, format->BitsPerPixel, format->Rmask, format->Gmask, format->Bmask, format->Amask);
+	if(mirrored == NULL)
+	{
+		return NULL;
+	}
+
+	if(format->palette != NULL)
+	{
+		SDL_SetColors(mirrored, format->palette->colors, 0, format->palette->ncolors);
+	}
+
+	mirror_rows(sheet, clip, mirrored);
+
+	// Keep the sheet's color key
+	if((sheet->flags & SDL_SRCCOLORKEY) != 0)
+	{
+		SDL_SetColorKey(mirrored, SDL_SRCCOLORKEY | SDL_RLEACCEL, format->colorkey);
+	}
+
+	mirrors[key] = mirrored;
+	return mirrored;
+}
+
+void MirrorCache::mirror_rows(SDL_Surface *source, SDL_Rect *clip, SDL_Surface *destination)
+{
+	int bytes = source->format->BytesPerPixel;
+
+	if(SDL_MUSTLOCK(source))
+	{
+		SDL_LockSurface(source);
+	}
+	if(SDL_MUSTLOCK(destination))
+	{
+		SDL_LockSurface(destination);
+	}
+
+	for(int y = 0; y < clip->h; y++)
+	{
+		// The start of the row in the clip and the end of the row in the copy
+		Uint8 *from = (Uint8 *)source->pixels + (clip->y + y) * source->pitch + clip->x * bytes;
+		Uint8 *to = (Uint8 *)destination->pixels + y * destination->pitch + (clip->w - 1) * bytes;
+
+		// Whole pixels at a time for 32 bit surfaces
+		if(bytes == 4)
+		{
+			Uint32 *in = (Uint32 *)from;
+			Uint32 *out = (Uint32 *)to;
+			for(int x = 0; x < clip->w; x++)
+			{
+				out[-x] = in[x];
+			}
+		}
+		else
+		{
+			for(int x = 0; x < clip->w; x++)
+			{
+				memcpy(to - x * bytes, from + x * bytes, bytes);
+			}
+		}
+	}
+
+	if(SDL_MUSTLOCK(destination))
+	{
+		SDL_UnlockSurface(destination);
+	}
+	if(SDL_MUSTLOCK(source))
+	{
+		SDL_UnlockSurface(source);
+	}
+}
+
+void MirrorCache::clear()
+{
+	for(std::map<Key, SDL_Surface *>::iterator mirror = mirrors.begin(); mirror != mirrors.end(); mirror++)
+	{
+		SDL_FreeSurface(mirror->second);
+	}
+	mirrors.clear();
+}
+
+int AnimationSet::add_clip(int mode, int next)
+{
+	Clip clip;
+	clip.mode = mode;
+	clip.next = next;
+	clip.cycle = 0;
+
+	clips.push_back(clip);
+	return clips.size() - 1;
+}
+
+void AnimationSet::add_frame(int clip, int frame, double duration)
+{
+	Clip &adding = clips[clip];
+
+	// A frame has to last some time or updates could go round forever
+	if(duration < 1)
+	{
+		duration = 1;
+	}
+
+	adding.frames.push_back(frame);
+	adding.durations.push_back(duration);
+
+	// A loop comes round after every frame, a ping pong after every frame there and the middle ones back
+	adding.cycle = 0;
+	for(unsigned int i = 0; i < adding.durations.size(); i++)
+	{
+		adding.cycle += adding.durations[i];
+		if((adding.mode == ANIM_PING_PONG) && (i > 0) && (i + 1 < adding.durations.size()))
+		{
+			adding.cycle += adding.durations[i];
+		}
+	}
+}
+
+void AnimationSet::add_transition(int from, int trigger, int to)
+{
+	clips[from].transitions[trigger] = to;
+}
+
+void AnimationSet::play(AnimationState &state, int clip)
+{
+	// Let a playing animation carry on
+	if(state.clip == clip)
+	{
+		return;
+	}
+
+	state.clip = clip;
+	state.index = 0;
+	state.time = 0;
+	state.step = 1;
+}
+
+void AnimationSet::trigger(AnimationState &state, int trigger)
+{
+	std::map<int, int>::iterator transition = clips[state.clip].transitions.find(trigger);
+	if(transition != clips[state.clip].transitions.end())
+	{
+		play(state, transition->second);
+	}
+}
+
+void AnimationSet::update(AnimationState &state, double elapsed)
+{
+	state.time += elapsed;
+
+	Clip *clip = &clips[state.clip];
+	if(clip->frames.empty() == true)
+	{
+		return;
+	}
+
+	// Whole trips round a looping animation end up where they started, so skip them
+	if((clip->mode != ANIM_ONCE) && (state.time >= clip->cycle))
+	{
+		state.time = fmod(state.time, clip->cycle);
+	}
+
+	// Step through every frame that's been shown long enough
+	while(state.time >= clip->durations[state.index])
+	{
+		int last = clip->frames.size() - 1;
+
+		if(clip->mode == ANIM_ONCE)
+		{
+			if(state.index < last)
+			{
+				state.time -= clip->durations[state.index];
+				state.index++;
+			}
+
+			// Go on to the next animation with the time that's left over
+			else if(clip->next >= 0)
+			{
+				double left = state.time - clip->durations[state.index];
+				state.clip = clip->next;
+				state.index = 0;
+				state.time = left;
+				state.step = 1;
+
+				clip = &clips[state.clip];
+				if(clip->frames.empty() == true)
+				{
+					return;
+				}
+
+				// Skip whole trips round it too if it loops
+				if((clip->mode != ANIM_ONCE) && (state.time >= clip->cycle))
+				{
+					state.time = fmod(state.time, clip->cycle);
+				}
+			}
+
+			// Stop on the last frame
+			else
+			{
+				state.time = clip->durations[state.index];
+				return;
+			}
+		}
+		else
+		{
+			state.time -= clip->durations[state.index];
+
+			if(clip->mode == ANIM_LOOP)
+			{
+				state.index = (state.index + 1) % clip->frames.size();
+			}
+
+			// Turn round at either end
+			else if(last > 0)
+			{
+				if((state.index + state.step < 0) || (state.index + state.step > last))
+				{
+					state.step = -state.step;
+				}
+				state.index += state.step;
+			}
+		}
+	}
+}
+
+int AnimationSet::get_frame(const AnimationState &state)
+{
+	const Clip &clip = clips[state.clip];
+	if(clip.frames.empty() == true)
+	{
+		return 0;
+	}
+	return clip.frames[state.index];
+}
+
+bool AnimationSet::is_done(const AnimationState &state)
+{
+	const Clip &clip = clips[state.clip];
+	if(clip.frames.empty() == true)
+	{
+		return true;
+	}
+	return (clip.mode == ANIM_ONCE) && (clip.next < 0) && (state.index + 1 >= (int)clip.frames.size()) && (state.time >= clip.durations.back());
+}
@@ -0,0 +1,313 @@
+/* Atlas packer.
+   Packs sprites from many images onto a few large atlas pages and writes an index of where each one went,
+   so a sample can load the pages once and look its clips up by name.
+
+   atlasPacker [-size N] output name=image[:WxH] ...
+
+   An image with :WxH is cut into frames that size, left to right then top to bottom, named name0, name1 and so on.
+   Writes output0.bmp, output1.bmp ... and output.txt, which lists the pages as "page file" then each sprite as
+   "name page x y w h".
+*/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "SDL.h"
+#include "SDL_image.h"
+
+// The default width and height of an atlas page
+const int ATLAS_SIZE = 1024;
+
+// A sprite to pack
+struct Sprite
+{
+	// The name it's looked up by
+	std::string name;
+
+	// The image it comes from and where in it
+	int image;
+	SDL_Rect source;
+
+	// Where it was packed
+	int page;
+	int x, y;
+};
+
+// An atlas page filled in shelves, each shelf as tall as the first sprite put on it
+struct Page
+{
+	SDL_Surface *surface;
+
+	// The top of the current shelf, how far along it's filled and how tall it is
+	int shelfY;
+	int shelfX;
+	int shelfHeight;
+};
+
+// Puts the tallest sprites first so each shelf wastes as little height as it can
+bool tallest_first(const Sprite &a, const Sprite &b)
+{
+	if(a.source.h != b.source.h)
+	{
+		return a.source.h > b.source.h;
+	}
+	return a.source.w > b.source.w;
+}
+
+// Finds room for the sprite on the page, starting a new shelf if the current one is full
+// The page is only changed if the sprite is placed, so a sprite that doesn't fit leaves the shelf open for smaller ones
+bool place(Page &page, Sprite &sprite, int size)
+{
+	int shelfY = page.shelfY;
+	int shelfX = page.shelfX;
+	int shelfHeight = page.shelfHeight;
+
+	// If it doesn't fit on the rest of the shelf, start another below it
+	if(shelfX + sprite.source.w > size)
+	{
+		shelfY += shelfHeight;
+		shelfX = 0;
+		shelfHeight = 0;
+	}
+
+	// If there's no room left below
+	if(shelfY + sprite.source.h > size)
+	{
+		return false;
+	}
+
+	sprite.x = shelfX;
+	sprite.y = shelfY;
+
+	page.shelfY = shelfY;
+	page.shelfX = shelfX + sprite.source.w;
+	page.shelfHeight = std::max(shelfHeight, (int)sprite.source.h);
+
+	return true;
+}
+
+// Loads an image into the 32 bit format the pages use, copying the pixels straight
+SDL_Surface *load_image(std::string filename)
+{
+	SDL_Surface *loadedImage = IMG_Load(filename.c_str());
+	if(loadedImage == NULL)
+	{
+		return NULL;
+	}
+
+	SDL_Surface *converted = SDL_CreateRGBSurface(SDL_SWSURFACE, loadedImage->w, loadedImage->h, 32, 0x00FF0000, 0x0000FF00, 0x000000FF, 0);
+	if(converted != NULL)
+	{
+		SDL_SetAlpha(loadedImage, 0, 0);
+		SDL_SetColorKey(loadedImage, 0, 0);
+		SDL_BlitSurface(loadedImage, NULL, converted, NULL);
+	}
+
+	SDL_FreeSurface(loadedImage);
+	return converted;
+}
+
+int main(int argc, char *args[])
+{
+	int size = ATLAS_SIZE;
+	int first = 1;
+
+	// Read the page size
+	if((argc > 2) && (strcmp(args[1], "-size") == 0))
+	{
+		size = atoi(args[2]);
+		first = 3;
+	}
+
+	if((argc - first < 2) || (size <= 0))
+	{
+		std::cerr << "Usage: atlasPacker [-size N] output name=image[:WxH] ..." << std::endl;
+		return 1;
+	}
+
+	std::string output = args[first];
+
+	// No window is needed, only the image loader
+	if(SDL_Init(0) == -1)
+	{
+		return 2;
+	}
+
+	std::vector<SDL_Surface *> images;
+	std::vector<Sprite> sprites;
+
+	// Load the images and cut them into sprites
+	for(int i = first + 1; i < argc; i++)
+	{
+		std::string arg = args[i];
+
+		// Split name=image[:WxH]
+		size_t equals = arg.find('=');
+		if(equals == std::string::npos)
+		{
+			std::cerr << "Bad sprite: " << arg << std::endl;
+			return 1;
+		}
+		std::string name = arg.substr(0, equals);
+		std::string file = arg.substr(equals + 1);
+		int frameW = 0, frameH = 0;
+
+		size_t colon = file.rfind(':');
+		if((colon != std::string::npos) && (sscanf(file.c_str() + colon + 1, "%dx%d", &frameW, &frameH) == 2))
+		{
+			file = file.substr(0, colon);
+		}
+
+		SDL_Surface *image = load_image(file);
+		if(image == NULL)
+		{
+			std::cerr << "Couldn't load " << file << std::endl;
+			return 3;
+		}
+		images.push_back(image);
+
+		// A whole image is one frame
+		if((frameW <= 0) || (frameH <= 0))
+		{
+			frameW = image->w;
+			frameH = image->h;
+		}
+
+		if((frameW > size) || (frameH > size))
+		{
+			std::cerr << file << " doesn't fit on a " << size << " page" << std::endl;
+			return 4;
+		}
+
+		// Cut the frames out
+		int frame = 0;
+		for(int y = 0; y + frameH <= image->h; y += frameH)
+		{
+			for(int x = 0; x + frameW <= image->w; x += frameW)
+			{
+				Sprite sprite;
+				sprite.name = name;
+				if((frameW != image->w) || (frameH != image->h))
+				{
+					std::stringstream frameName;
+					frameName << name << frame;
+					sprite.name = frameName.str();
+				}
+				sprite.image = images.size() - 1;
+				sprite.source.x = x;
+				sprite.source.y = y;
+				sprite.source.w = frameW;
+				sprite.source.h = frameH;
+				sprite.page = -1;
+				sprites.push_back(sprite);
+
+				frame++;
+			}
+		}
+	}
+
+	// Pack the sprites onto the first page with room, tallest first
+	std::stable_sort(sprites.begin(), sprites.end(), tallest_first);
+
+	std::vector<Page> pages;
+	for(unsigned int i = 0; i < sprites.size(); i++)
+	{
+		for(unsigned int p = 0; p < pages.size(); p++)
+		{
+			if(place(pages[p], sprites[i], size) == true)
+			{
+				sprites[i].page = p;
+				break;
+			}
+		}
+
+		// If no page had room, start a new one
+		if(sprites[i].page == -1)
+		{
+			Page page;
+			page.surface = SDL_CreateRGBSurface(SDL_SWSURFACE, size, size, 32, 0x00FF0000, 0x0000FF00, 0x000000FF, 0);
+			if(page.surface == NULL)
+			{
+				return 5;
+			}
+
+			// Leave the unused parts transparent
+			SDL_FillRect(page.surface, NULL, SDL_MapRGB(page.surface->format, 0, 0xFF, 0xFF));
+
+			page.shelfY = 0;
+			page.shelfX = 0;
+			page.shelfHeight = 0;
+			pages.push_back(page);
+
+			place(pages.back(), sprites[i], size);
+			sprites[i].page = pages.size() - 1;
+		}
+
+		// Copy the sprite onto its page
+		SDL_Rect offset;
+		offset.x = sprites[i].x;
+		offset.y = sprites[i].y;
+		SDL_BlitSurface(images[sprites[i].image], &sprites[i].source, pages[sprites[i].page].surface, &offset);
+	}
+
+	std::ofstream index((output + ".txt").c_str());
+	if(index.fail() == true)
+	{
+		std::cerr << "Couldn't open " << output << ".txt" << std::endl;
+		return 6;
+	}
+
+	// Save the pages
+	for(unsigned int p = 0; p < pages.size(); p++)
+	{
+		std::stringstream pageFile;
+		pageFile << output << p << ".bmp";
+
+		if(SDL_SaveBMP(pages[p].surface, pageFile.str().c_str()) == -1)
+		{
+			std::cerr << "Couldn't write " << pageFile.str() << std::endl;
+			return 6;
+		}
+
+		// Pages are found next to the index
+		std::string name = pageFile.str();
+		size_t slash = name.find_last_of("/\\");
+		if(slash != std::string::npos)
+		{
+			name = name.substr(slash + 1);
+		}
+		index << "page " << name << std::endl;
+
+		SDL_FreeSurface(pages[p].surface);
+	}
+
+	// Write where each sprite went
+	for(unsigned int i = 0; i < sprites.size(); i++)
+	{
+		index << sprites[i].name << " " << sprites[i].page << " " << sprites[i].x << " " << sprites[i].y << " " << sprites[i].source.w << " " << sprites[i].source.h << std::endl;
+	}
+
+	for(unsigned int i = 0; i < images.size(); i++)
+	{
+		SDL_FreeSurface(images[i]);
+	}
+
+	bool failed = index.fail();
+	index.close();
+	SDL_Quit();
+
+	if(failed == true)
+	{
+		std::cerr << "Couldn't write " << output << ".txt" << std::endl;
+		return 6;
+	}
+
+	std::cout << sprites.size() << " sprites on " << pages.size() << " pages" << std::endl;
+	return 0;
+}
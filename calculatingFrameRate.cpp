@@ -1,7 +1,11 @@
 // Headers
 #include <iostream>
 #include <string>
+#include <chrono>
 #include <sstream>
+#include <iomanip>
+#include <vector>
+#include <deque>
 #include "SDL.h"
 #include "SDL_image.h"
 #include "SDL_ttf.h"
@@ -11,6 +15,13 @@ const int SCREEN_WIDTH = 640;
 const int SCREEN_HEIGHT = 480;
 const int SCREEN_BPP = 32;
 
+// The number of frames the statistics are taken over
+const int STATS_WINDOW = 240;
+
+// The frame time histogram used for percentiles, the last bucket holds everything slower
+const double STATS_BUCKET_SIZE = 0.1;
+const int STATS_BUCKETS = 1000;
+
 // Prototypes
 bool init();
 bool load_files();
@@ -25,7 +36,8 @@ public:
   Timer();
 	bool is_paused();
 	bool is_started();
-	int get_ticks();
+	double get_ticks();
+	std::chrono::nanoseconds get_time();
 	void start();
 	void stop();
 	void pause();
@@ -33,11 +45,45 @@ public:
 private:
 	bool started;
 	bool paused;
-	int pausedTicks;
-	int startTicks;
+	std::chrono::nanoseconds pausedTime;
+	std::chrono::steady_clock::time_point startTime;
 
 };
 
+// Rolling statistics over the durations of the last few frames
+class FrameStats
+{
+public:
+	// Sets the number of frames to keep
+	FrameStats(int window);
+	// Records how long a frame took in milliseconds, the oldest frame drops out once the window is full
+	void add(double frameTime);
+	// The number of frames in the window
+	int get_count();
+	// Frame time statistics in milliseconds
+	double get_mean();
+	double get_min();
+	double get_max();
+	// Gets the frame time the given fraction of frames are at or under, to the histogram's bucket size
+	double get_percentile(double fraction);
+	// Gets the frame rate at the slowest 1% of frames
+	double get_low_fps();
+private:
+	// The frame times, written round in a ring
+	std::vector<double> times;
+	// The number of frames added so far
+	long long frames;
+	// The total of the frame times in the window
+	double total;
+	// The number of frames in each histogram bucket
+	std::vector<int> histogram;
+	// The frame numbers that could still become the min and max as older frames drop out
+	std::deque<long long> minFrames;
+	std::deque<long long> maxFrames;
+	// Gets the histogram bucket for a frame time
+	int bucket(double frameTime);
+};
+
 // Events
 SDL_Event event;
 
@@ -56,8 +102,10 @@ int main(int argc, char *args[])
 {
 	// Flag for user to quit
 	bool quit = false;
-	// Keep track of the frame count
-	int frame = 0;
+	// The frame time statistics
+	FrameStats stats(STATS_WINDOW);
+	// The time the last frame ended
+	double lastFrame = 0;
 
 	if(init() == false)
 	{
@@ -69,7 +117,7 @@ int main(int argc, char *args[])
 		return 1;
 	}
 
-	// Timer used to calculate the fps
+	// Timer used to measure the frame times
 	Timer fps;
 
 	// Timer used to update the caption
@@ -79,7 +127,7 @@ int main(int argc, char *args[])
 	update.start();
 	fps.start();
 	
-	message = TTF_RenderText_Solid(font, "Testing average frames per second", textColor);
+	message = TTF_RenderText_Solid(font, "Testing frame time statistics", textColor);
 
 	while(quit == false)
 	{
@@ -99,8 +147,10 @@ int main(int argc, char *args[])
 			return 1;
 		}
 
-		// Increment the frame counter
-		frame++;
+		// Record how long the frame took
+		double now = fps.get_ticks();
+		stats.add(now - lastFrame);
+		lastFrame = now;
 
 		// If a second has passed since the caption was last updated
 		if(update.get_ticks() > 1000)
@@ -108,8 +158,11 @@ int main(int argc, char *args[])
 			// The frame rate as a string
 			std::stringstream caption;
 
-			// Calculate the frames per second and create the string
-			caption << "Average Frames Per Second: " << frame / (fps.get_ticks()/1000.f);
+			// Show the rolling frame rate and frame time spread
+			// Fixed point so rates over 1000 aren't shown in exponent form, frame times are well under a millisecond uncapped
+			caption << std::fixed << std::setprecision(1) << "FPS: " << 1000 / stats.get_mean() << " 1% Low: " << stats.get_low_fps()
+				<< std::setprecision(3) << " | ms p50: " << stats.get_percentile(0.5) << " p95: " << stats.get_percentile(0.95)
+				<< " p99: " << stats.get_percentile(0.99) << " Min: " << stats.get_min() << " Max: " << stats.get_max();
 
 			// Reset the caption
 			SDL_WM_SetCaption(caption.str().c_str(), NULL);
@@ -206,24 +259,29 @@ Timer::Timer()
 {
 	paused = false;
 	started = false;
-	startTicks = 0;
-	pausedTicks = 0;
+	startTime = std::chrono::steady_clock::time_point();
+	pausedTime = std::chrono::nanoseconds::zero();
 }
 
-int Timer::get_ticks()
+std::chrono::nanoseconds Timer::get_time()
 {
 	if(started == true)
 	{
 		if(paused == true)
 		{
-			return pausedTicks;
+			return pausedTime;
 		}
 		else
 		{
-			return SDL_GetTicks() - startTicks;
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime);
 		}
 	}
-	return 0;
+	return std::chrono::nanoseconds::zero();
+}
+
+double Timer::get_ticks()
+{
+	return std::chrono::duration<double, std::milli>(get_time()).count();
 }
 
 bool Timer::is_paused()
@@ -241,7 +299,7 @@ void Timer::pause()
 	if((started == true)&&(paused == false))
 	{
 		paused = true;
-		pausedTicks = SDL_GetTicks() - startTicks;
+		pausedTime = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime);
 	}
 }
 
@@ -250,8 +308,8 @@ void Timer::unpause()
 	if(paused == true)
 	{
 		paused = false;
-		startTicks = SDL_GetTicks() - pausedTicks;
-		pausedTicks = 0;
+		startTime = std::chrono::steady_clock::now() - pausedTime;
+		pausedTime = std::chrono::nanoseconds::zero();
 	}
 }
 
@@ -259,7 +317,7 @@ void Timer::start()
 {
 	started = true;
 	paused = false;
-	startTicks = SDL_GetTicks();
+	startTime = std::chrono::steady_clock::now();
 
 }
 
@@ -268,3 +326,142 @@ void Timer::stop()
 	started = false;
 	paused = false;
 }
+
+FrameStats::FrameStats(int window)
+{
+	times.resize(window);
+	frames = 0;
+	total = 0;
+	histogram.resize(STATS_BUCKETS, 0);
+}
+
+int FrameStats::bucket(double frameTime)
+{
+	int i = (int)(frameTime / STATS_BUCKET_SIZE);
+	if(i < 0)
+	{
+		return 0;
+	}
+	if(i >= STATS_BUCKETS)
+	{
+		return STATS_BUCKETS - 1;
+	}
+	return i;
+}
+
+void FrameStats::add(double frameTime)
+{
+	int window = (int)times.size();
+	int slot = frames % window;
+
+	// If the window is full, take out the frame being overwritten
+	if(frames >= window)
+	{
+		total -= times[slot];
+		histogram[bucket(times[slot])]--;
+
+		// Drop it from the min and max candidates
+		if(minFrames.front() == frames - window)
+		{
+			minFrames.pop_front();
+		}
+		if(maxFrames.front() == frames - window)
+		{
+			maxFrames.pop_front();
+		}
+	}
+
+	// Put in the new frame
+	times[slot] = frameTime;
+	total += frameTime;
+	histogram[bucket(frameTime)]++;
+
+	// Older frames that are slower can never be the min again, older faster ones can never be the max
+	while((minFrames.empty() == false) && (times[minFrames.back() % window] >= frameTime))
+	{
+		minFrames.pop_back();
+	}
+	minFrames.push_back(frames);
+
+	while((maxFrames.empty() == false) && (times[maxFrames.back() % window] <= frameTime))
+	{
+		maxFrames.pop_back();
+	}
+	maxFrames.push_back(frames);
+
+	frames++;
+}
+
+int FrameStats::get_count()
+{
+	if(frames < (long long)times.size())
+	{
+		return (int)frames;
+	}
+	return (int)times.size();
+}
+
+double FrameStats::get_mean()
+{
+	if(get_count() == 0)
+	{
+		return 0;
+	}
+	return total / get_count();
+}
+
+double FrameStats::get_min()
+{
+	if(get_count() == 0)
+	{
+		return 0;
+	}
+	return times[minFrames.front() % times.size()];
+}
+
+double FrameStats::get_max()
+{
+	if(get_count() == 0)
+	{
+		return 0;
+	}
+	return times[maxFrames.front() % times.size()];
+}
+
+double FrameStats::get_percentile(double fraction)
+{
+	// The number of frames that have to be at or under the result
+	int needed = (int)(fraction * get_count() + 0.5);
+	if(needed < 1)
+	{
+		needed = 1;
+	}
+
+	// Go up through the buckets until enough frames are counted
+	int counted = 0;
+	for(int i = 0; i < STATS_BUCKETS; i++)
+	{
+		counted += histogram[i];
+		if(counted >= needed)
+		{
+			// The top of the bucket, the slowest bucket can't know its top so use the max
+			if(i == STATS_BUCKETS - 1)
+			{
+				return get_max();
+			}
+			return (i + 1) * STATS_BUCKET_SIZE;
+		}
+	}
+
+	return 0;
+}
+
+double FrameStats::get_low_fps()
+{
+	double slow = get_percentile(0.99);
+	if(slow <= 0)
+	{
+		return 0;
+	}
+	return 1000 / slow;
+}
@@ -1,10 +1,21 @@
 #include <iostream>
 #include <string>
+#include <chrono>
+#include <thread>
 #include <vector>
+#include <algorithm>
 #include <cmath>
+#include <cstdlib>
 #include "SDL.h"
 #include "SDL_image.h"
 
+// Vector instructions for the batch tests
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
 // Constants
 const int SCREEN_WIDTH = 640;
 const int SCREEN_HEIGHT = 480;
@@ -13,6 +24,9 @@ const int DOT_WIDTH = 20;
 const int DOT_HEIGHT = 20;
 const int FRAMES_PER_SECOND = 20;
 
+// How long before a deadline the frame pacer stops sleeping and spins, in milliseconds
+const double PACER_SPIN_TIME = 2.0;
+
 // Surfaces
 SDL_Surface *screen = NULL;
 SDL_Surface *dot = NULL;
@@ -30,6 +44,26 @@ struct Circle
 	int r;
 };
 
+// Many circles laid out as a structure of arrays for the batch tests
+struct CircleBatch
+{
+	std::vector<float> x, y, r;
+
+	// Adds a circle to the end of the batch
+	void add(Circle &c);
+	int size();
+};
+
+// Many boxes laid out as a structure of arrays for the batch tests
+struct RectBatch
+{
+	std::vector<float> x, y, w, h;
+
+	// Adds a box to the end of the batch
+	void add(SDL_Rect &box);
+	int size();
+};
+
 // Classes
 class Dot
 {
@@ -41,7 +75,7 @@ class Dot
 	void handle_input();
 
 	// Moves the dot
-	void move(std::vector<SDL_Rect> &rects, Circle &circle);
+	void move(RectBatch &rects, CircleBatch &circles);
 
 	// Shows the dot on the screen
 	void show();
@@ -52,6 +86,9 @@ class Dot
 
 	// The veolicty of the dot
 	int xVel, yVel;
+
+	// Finds how far the dot can move along one axis before it touches a shape, at most the whole step
+	int sweep(int xStep, int yStep, RectBatch &rects, CircleBatch &circles);
 };
 
 class Timer
@@ -60,28 +97,59 @@ class Timer
 		Timer();
 		bool is_started();
 		bool is_paused();
-		int get_ticks();
+		double get_ticks();
+		std::chrono::nanoseconds get_time();
 		void start();
 		void pause();
 		void stop();
 		void unpause();
 
 	private:
-		int startTicks;
-		int pausedTicks;
+		std::chrono::steady_clock::time_point startTime;
+		std::chrono::nanoseconds pausedTime;
 		bool paused;
 		bool started;
 };
 
+// Holds frames to a fixed rate against a running deadline
+class FramePacer
+{
+	public:
+		// Sets the frame rate to pace to
+		FramePacer(int framesPerSecond);
+
+		// Sets the first deadline one frame from now
+		void start();
+
+		// Waits for the current deadline and moves it on by one frame
+		void wait();
+
+		// Gets the number of deadlines that had already passed when waited on
+		int get_missed();
+
+	private:
+		// The time since pacing started
+		Timer clock;
+
+		// The length of a frame in milliseconds
+		double frameLength;
+
+		// When the current frame should end
+		double deadline;
+
+		// The number of missed deadlines
+		int missed;
+};
+
 // Prototypes
 bool init();
 SDL_Surface *load_image(std::string filename);
 bool load_files();
 void apply_surface(int x, int y, SDL_Surface* source, SDL_Surface * destination, SDL_Rect* clip = NULL);
 void clean_up();
-double distance(int x1, int y1, int x2, int y2);
-bool check_collision(Circle &A, Circle &B);
-bool check_collision(Circle &A, std::vector<SDL_Rect> &B);
+bool check_collision(Circle &A, CircleBatch &B, std::vector<Uint32> &hits);
+bool check_collision(Circle &A, RectBatch &B, std::vector<Uint32> &hits);
+int contact_distance(int reach, int across);
 
 int main(int argc, char **args)
 {
@@ -112,16 +180,23 @@ int main(int argc, char **args)
 	otherDot.x = 30;
 	otherDot.y = 30;
 	otherDot.r = DOT_WIDTH / 2;
+
+	// Lay the shapes out for the batch tests
+	RectBatch boxes;
+	boxes.add(box[0]);
+
+	CircleBatch circles;
+	circles.add(otherDot);
 	
 	// Create timer for frame limit
-	Timer fps;
+	FramePacer fps(FRAMES_PER_SECOND);
+
+	// Start pacing frames
+	fps.start();
 
 	// While the user hasn't quit
 	while(quit == false)
 	{
-		// Start timer
-		fps.start();
-
 		// While there are events to handle
 		while(SDL_PollEvent(&event))
 		{
@@ -136,7 +211,7 @@ int main(int argc, char **args)
 		}
 
 		// Move the dot
-		myDot.move(box, otherDot);
+		myDot.move(boxes, circles);
 	
 		// Fill the screen white
 		SDL_FillRect(screen, &screen->clip_rect,  SDL_MapRGB(screen->format, 0xFF, 0xFF, 0xFF));
@@ -157,10 +232,7 @@ int main(int argc, char **args)
 		}
 
 		// Cap the frame rate
-		if(fps.get_ticks() < 1000 / FRAMES_PER_SECOND)
-		{
-			SDL_Delay((1000 / FRAMES_PER_SECOND) - fps.get_ticks());
-		}
+		fps.wait();
 	}
 
 	clean_up();
@@ -229,71 +301,155 @@ void clean_up()
 	SDL_Quit();
 }
 
-double distance(int x1, int y1, int x2, int y2)
+// Check collision for one circle against a batch of circles, bit i of the hit mask is set if circle i was hit
+bool check_collision(Circle &A, CircleBatch &B, std::vector<Uint32> &hits)
 {
-	// Return the distance between the two points
-	return sqrt(pow(x2 - x1, 2.) + pow( y2 - y1, 2.));
-}
+	int count = B.size();
+	hits.assign((count + 31) / 32, 0);
+
+	// Any hit at all
+	Uint32 any = 0;
+	int i = 0;
+
+#if defined(__AVX__)
+	// Test eight circles at a time
+	__m256 aX = _mm256_set1_ps(A.x);
+	__m256 aY = _mm256_set1_ps(A.y);
+	__m256 aR = _mm256_set1_ps(A.r);
+	for(; i + 8 <= count; i += 8)
+	{
+		__m256 dX = _mm256_sub_ps(_mm256_loadu_ps(&B.x[i]), aX);
+		__m256 dY = _mm256_sub_ps(_mm256_loadu_ps(&B.y[i]), aY);
+		__m256 rr = _mm256_add_ps(_mm256_loadu_ps(&B.r[i]), aR);
+		__m256 d2 = _mm256_add_ps(_mm256_mul_ps(dX, dX), _mm256_mul_ps(dY, dY));
+		Uint32 bits = _mm256_movemask_ps(_mm256_cmp_ps(d2, _mm256_mul_ps(rr, rr), _CMP_LT_OQ));
+		hits[i / 32] |= bits << (i % 32);
+		any |= bits;
+	}
+#elif defined(__SSE__)
+	// Test four circles at a time
+	__m128 aX = _mm_set1_ps(A.x);
+	__m128 aY = _mm_set1_ps(A.y);
+	__m128 aR = _mm_set1_ps(A.r);
+	for(; i + 4 <= count; i += 4)
+	{
+		__m128 dX = _mm_sub_ps(_mm_loadu_ps(&B.x[i]), aX);
+		__m128 dY = _mm_sub_ps(_mm_loadu_ps(&B.y[i]), aY);
+		__m128 rr = _mm_add_ps(_mm_loadu_ps(&B.r[i]), aR);
+		__m128 d2 = _mm_add_ps(_mm_mul_ps(dX, dX), _mm_mul_ps(dY, dY));
+		Uint32 bits = _mm_movemask_ps(_mm_cmplt_ps(d2, _mm_mul_ps(rr, rr)));
+		hits[i / 32] |= bits << (i % 32);
+		any |= bits;
+	}
+#endif
 
-// Check collision for two instances of circle
-bool check_collision(Circle &A, Circle &B)
-{
-	// If the distance between the centers of the circles is less than the sum of their radii
-	if(distance(A.x, A.y, B.x, B.y) < (A.r + B.r))
+	// Test the rest one at a time
+	for(; i < count; i++)
 	{
-		// The circles have collided
-		return true;
+		float dX = B.x[i] - A.x;
+		float dY = B.y[i] - A.y;
+		float rr = B.r[i] + A.r;
+		if(dX * dX + dY * dY < rr * rr)
+		{
+			hits[i / 32] |= 1u << (i % 32);
+			any = 1;
+		}
 	}
 
-	// If not
-	return false;
+	return any != 0;
 }
 
-// Check collision for for instance of cicle vs 
-bool check_collision(Circle &A, std::vector<SDL_Rect> &B)
+// Check collision for one circle against a batch of boxes, bit i of the hit mask is set if box i was hit
+bool check_collision(Circle &A, RectBatch &B, std::vector<Uint32> &hits)
 {
-	// Closest point on collision box
-	int cX, cY;
+	int count = B.size();
+	hits.assign((count + 31) / 32, 0);
+
+	// Any hit at all
+	Uint32 any = 0;
+	int i = 0;
+
+#if defined(__AVX__)
+	// Test eight boxes at a time
+	__m256 aX = _mm256_set1_ps(A.x);
+	__m256 aY = _mm256_set1_ps(A.y);
+	__m256 aR = _mm256_set1_ps(A.r);
+	for(; i + 8 <= count; i += 8)
+	{
+		// Clamp the center to the box to find the closest point
+		__m256 left = _mm256_loadu_ps(&B.x[i]);
+		__m256 top = _mm256_loadu_ps(&B.y[i]);
+		__m256 cX = _mm256_min_ps(_mm256_max_ps(aX, left), _mm256_add_ps(left, _mm256_loadu_ps(&B.w[i])));
+		__m256 cY = _mm256_min_ps(_mm256_max_ps(aY, top), _mm256_add_ps(top, _mm256_loadu_ps(&B.h[i])));
+		__m256 dX = _mm256_sub_ps(cX, aX);
+		__m256 dY = _mm256_sub_ps(cY, aY);
+		__m256 d2 = _mm256_add_ps(_mm256_mul_ps(dX, dX), _mm256_mul_ps(dY, dY));
+		Uint32 bits = _mm256_movemask_ps(_mm256_cmp_ps(d2, _mm256_mul_ps(aR, aR), _CMP_LT_OQ));
+		hits[i / 32] |= bits << (i % 32);
+		any |= bits;
+	}
+#elif defined(__SSE__)
+	// Test four boxes at a time
+	__m128 aX = _mm_set1_ps(A.x);
+	__m128 aY = _mm_set1_ps(A.y);
+	__m128 aR = _mm_set1_ps(A.r);
+	for(; i + 4 <= count; i += 4)
+	{
+		// Clamp the center to the box to find the closest point
+		__m128 left = _mm_loadu_ps(&B.x[i]);
+		__m128 top = _mm_loadu_ps(&B.y[i]);
+		__m128 cX = _mm_min_ps(_mm_max_ps(aX, left), _mm_add_ps(left, _mm_loadu_ps(&B.w[i])));
+		__m128 cY = _mm_min_ps(_mm_max_ps(aY, top), _mm_add_ps(top, _mm_loadu_ps(&B.h[i])));
+		__m128 dX = _mm_sub_ps(cX, aX);
+		__m128 dY = _mm_sub_ps(cY, aY);
+		__m128 d2 = _mm_add_ps(_mm_mul_ps(dX, dX), _mm_mul_ps(dY, dY));
+		Uint32 bits = _mm_movemask_ps(_mm_cmplt_ps(d2, _mm_mul_ps(aR, aR)));
+		hits[i / 32] |= bits << (i % 32);
+		any |= bits;
+	}
+#endif
 
-	// Go through the boxes
-	for(int Bbox = 0; Bbox < ((int)B.size()); Bbox++)
+	// Test the rest one at a time
+	for(; i < count; i++)
 	{
-		// Find the closest X offset
-		if(A.x < B[Bbox].x)
-		{
-			cX = B[Bbox].x;
-		}
-		else if(A.x > B[Bbox].x + B[Bbox].h)
+		float cX = std::min(std::max((float)A.x, B.x[i]), B.x[i] + B.w[i]);
+		float cY = std::min(std::max((float)A.y, B.y[i]), B.y[i] + B.h[i]);
+		float dX = cX - A.x;
+		float dY = cY - A.y;
+		if(dX * dX + dY * dY < (float)(A.r * A.r))
 		{
-			cX = B[Bbox].x + B[Bbox].h;
-		}
-		else
-		{
-			cX = A.x;
-		}
-		// Find the closest Y offset
-		if(A.y < B[Bbox].y)
-		{
-			cY = B[Bbox].y;
-		}
-		else if(A.y > B[Bbox].y + B[Bbox].h)
-		{
-			cY = B[Bbox].y + B[Bbox].h;
-		}
-		else
-		{
-			cY = A.y;
-		}
-		// If the closest point is inside the circle
-		if(distance(A.x, A.y, cX, cY) < A.r)
-		{
-			// This box and the circle have collided
-			return true;
+			hits[i / 32] |= 1u << (i % 32);
+			any = 1;
 		}
 	}
-	
-	// If the shapes have not collided
-	return false;
+
+	return any != 0;
+}
+
+// Batch Function Definitions
+void CircleBatch::add(Circle &c)
+{
+	x.push_back(c.x);
+	y.push_back(c.y);
+	r.push_back(c.r);
+}
+
+int CircleBatch::size()
+{
+	return (int)x.size();
+}
+
+void RectBatch::add(SDL_Rect &box)
+{
+	x.push_back(box.x);
+	y.push_back(box.y);
+	w.push_back(box.w);
+	h.push_back(box.h);
+}
+
+int RectBatch::size()
+{
+	return (int)x.size();
 }
 
 // Timer Class Function Definitions
@@ -301,8 +457,8 @@ Timer::Timer()
 {
 	started = false;
 	paused = false;
-	pausedTicks = 0;
-	startTicks = 0;
+	pausedTime = std::chrono::nanoseconds::zero();
+	startTime = std::chrono::steady_clock::time_point();
 }
 
 bool Timer::is_started()
@@ -315,27 +471,32 @@ bool Timer::is_paused()
 	return paused;
 }
 
-int Timer::get_ticks()
+std::chrono::nanoseconds Timer::get_time()
 {
 	if(started == true)
 	{
 		if(paused == true)
 		{
-			return pausedTicks;
+			return pausedTime;
 		}
 		else
 		{
-			return SDL_GetTicks() - startTicks;
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime);
 		}
 	}
-	return 0;
+	return std::chrono::nanoseconds::zero();
+}
+
+double Timer::get_ticks()
+{
+	return std::chrono::duration<double, std::milli>(get_time()).count();
 }
 
 void Timer::start()
 {
 	started = true;
 	paused = false;
-	startTicks = SDL_GetTicks();
+	startTime = std::chrono::steady_clock::now();
 }
 
 void Timer::pause()
@@ -344,7 +505,7 @@ void Timer::pause()
 	{
 		paused = true;
 	}
-	pausedTicks = SDL_GetTicks() - startTicks;
+	pausedTime = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime);
 }
 
 void Timer::stop()
@@ -358,8 +519,8 @@ void Timer::unpause()
 	if(paused == true)
 	{
 		paused = false;
-		startTicks = SDL_GetTicks() - pausedTicks;
-		pausedTicks = 0;
+		startTime = std::chrono::steady_clock::now() - pausedTime;
+		pausedTime = std::chrono::nanoseconds::zero();
 	}
 }
 
@@ -398,25 +559,142 @@ void Dot::handle_input()
 	}
 }
 
-void Dot::move(std::vector<SDL_Rect> &rects, Circle &circle)
+// The least whole distance a center can be from a shape along the movement, with the rest of the gap across it,
+// before the two overlap
+int contact_distance(int reach, int across)
 {
-	// Move the dot on the x-axis
-	c.x += xVel;
+	// The squared distance left along the movement
+	int along = reach * reach - across * across;
 
-	// If the dot went too far or has collided
-	if((c.x - DOT_WIDTH / 2 < 0) || (c.x + DOT_WIDTH / 2 > SCREEN_WIDTH) || (check_collision(c, rects)) || (check_collision(c, circle)))
+	int distance = (int)sqrt((double)along);
+	while(distance * distance < along)
 	{
-		// Move back
-		c.x -= xVel;
+		distance++;
+	}
+	while((distance > 0) && ((distance - 1) * (distance - 1) >= along))
+	{
+		distance--;
+	}
+	return distance;
+}
+
+int Dot::sweep(int xStep, int yStep, RectBatch &rects, CircleBatch &circles)
+{
+	// The hit masks, kept between calls so they aren't reallocated
+	static std::vector<Uint32> rectHits;
+	static std::vector<Uint32> circleHits;
+
+	int step = (xStep != 0) ? xStep : yStep;
+	if(step == 0)
+	{
+		return 0;
+	}
+
+	// Anything touched on the way is within the radius plus the step of where the dot starts,
+	// the batch tests pick those out so only they are swept
+	Circle reach = c;
+	reach.r = c.r + abs(step);
+
+	bool nearRect = check_collision(reach, rects, rectHits);
+	bool nearCircle = check_collision(reach, circles, circleHits);
+	if((nearRect == false) && (nearCircle == false))
+	{
+		return step;
+	}
+
+	// Where the dot is along the movement and across it
+	int along = (xStep != 0) ? c.x : c.y;
+	int across = (xStep != 0) ? c.y : c.x;
+
+	// How far it can go
+	int travel = step;
+
+	for(int i = 0; i < rects.size() + circles.size(); i++)
+	{
+		bool isRect = i < rects.size();
+		int j = isRect ? i : i - rects.size();
+
+		// If the batch test ruled it out
+		std::vector<Uint32> &hits = isRect ? rectHits : circleHits;
+		if(((hits[j / 32] >> (j % 32)) & 1) == 0)
+		{
+			continue;
+		}
+
+		// The shape's near and far sides along the movement, its sides across it, and how close the center can come
+		int low, high, acrossLow, acrossHigh, radius;
+		if(isRect == true)
+		{
+			int x = (int)rects.x[j], y = (int)rects.y[j], w = (int)rects.w[j], h = (int)rects.h[j];
+			low = (xStep != 0) ? x : y;
+			high = (xStep != 0) ? x + w : y + h;
+			acrossLow = (xStep != 0) ? y : x;
+			acrossHigh = (xStep != 0) ? y + h : x + w;
+			radius = c.r;
+		}
+		else
+		{
+			low = high = (xStep != 0) ? (int)circles.x[j] : (int)circles.y[j];
+			acrossLow = acrossHigh = (xStep != 0) ? (int)circles.y[j] : (int)circles.x[j];
+			radius = c.r + (int)circles.r[j];
+		}
+
+		// The gap across the movement, if it's as wide as the radius the dot passes the shape by
+		int gap = 0;
+		if(across < acrossLow)
+		{
+			gap = acrossLow - across;
+		}
+		else if(across > acrossHigh)
+		{
+			gap = across - acrossHigh;
+		}
+		if(gap >= radius)
+		{
+			continue;
+		}
+
+		// Stop where the dot touches the shape, unless it already overlaps it or has gone past
+		int distance = contact_distance(radius, gap);
+		if((step > 0) && (along <= low - distance))
+		{
+			travel = std::min(travel, low - distance - along);
+		}
+		else if((step < 0) && (along >= high + distance))
+		{
+			travel = std::max(travel, high + distance - along);
+		}
 	}
 
-	// Move the dot on the y-axis
-	c.y += yVel;
+	return travel;
+}
+
+void Dot::move(RectBatch &rects, CircleBatch &circles)
+{
+	// Move the dot on the x-axis up to anything in the way
+	c.x += sweep(xVel, 0, rects, circles);
+
+	// If the dot went too far, stop at the edge
+	if(c.x - DOT_WIDTH / 2 < 0)
+	{
+		c.x = DOT_WIDTH / 2;
+	}
+	else if(c.x + DOT_WIDTH / 2 > SCREEN_WIDTH)
+	{
+		c.x = SCREEN_WIDTH - DOT_WIDTH / 2;
+	}
 
-	if((c.y - DOT_WIDTH / 2 < 0) || (c.y + DOT_WIDTH / 2 > SCREEN_HEIGHT) || (check_collision(c, rects)) || (check_collision(c, circle)))
+	// Move the dot on the y-axis up to anything in the way
+	c.y += sweep(0, yVel, rects, circles);
+
+	// If the dot went too far, stop at the edge
+	if(c.y - DOT_WIDTH / 2 < 0)
 	{
-		// Move back
-		c.y -= yVel;
+		c.y = DOT_WIDTH / 2;
+	}
+	else if(c.y + DOT_WIDTH / 2 > SCREEN_HEIGHT)
+	{
+		c.y = SCREEN_HEIGHT - DOT_WIDTH / 2;
 	}
 }
 
@@ -424,3 +702,57 @@ void Dot::show()
 {
 	apply_surface(c.x - c.r, c.y - c.r, dot, screen);
 }
+
+FramePacer::FramePacer(int framesPerSecond)
+{
+	// Initialize the variables
+	frameLength = 1000.0 / framesPerSecond;
+	deadline = 0;
+	missed = 0;
+}
+
+void FramePacer::start()
+{
+	// Start the clock with the first frame due one frame from now
+	clock.start();
+	deadline = frameLength;
+}
+
+void FramePacer::wait()
+{
+	double now = clock.get_ticks();
+
+	// If the frame ran past its deadline
+	if(now > deadline)
+	{
+		missed++;
+
+		// If it's a whole frame behind, start over from now instead of rushing to catch up
+		if(now - deadline >= frameLength)
+		{
+			deadline = now;
+		}
+	}
+	else
+	{
+		// Sleep through most of the wait, the OS may wake us late
+		if(deadline - now > PACER_SPIN_TIME)
+		{
+			SDL_Delay((Uint32)(deadline - now - PACER_SPIN_TIME));
+		}
+
+		// Spin out the rest against the clock
+		while(clock.get_ticks() < deadline)
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	// The next deadline is one frame after this one, so lateness doesn't add up
+	deadline += frameLength;
+}
+
+int FramePacer::get_missed()
+{
+	return missed;
+}
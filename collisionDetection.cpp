@@ -1,6 +1,10 @@
 // Headers
 #include <iostream>
 #include <string>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <limits>
 #include "SDL.h"
 #include "SDL_image.h"
 
@@ -14,13 +18,16 @@ const int SQUARE_WIDTH = 20;
 
 const int FRAMES_PER_SECOND = 20;
 
+// How long before a deadline the frame pacer stops sleeping and spins, in milliseconds
+const double PACER_SPIN_TIME = 2.0;
+
 // Prototypes
 bool init();
 SDL_Surface *load_image(std::string filename);
 bool load_files();
 void apply_surface(int x, int y, SDL_Surface *source, SDL_Surface *destination, SDL_Rect *clip = NULL);
 void clean_up();
-bool check_collision(SDL_Rect A, SDL_Rect B);
+float sweep_collision(SDL_Rect A, int xVel, int yVel, SDL_Rect B, int &normalX, int &normalY);
 
 // Surfaces
 SDL_Surface *screen = NULL;
@@ -45,8 +52,11 @@ class Timer
 	void pause();
 	void unpause();
 
-	// Get the timer's time
-	int get_ticks();
+	// Get the timer's time in milliseconds
+	double get_ticks();
+
+	// Get the timer's time at full resolution
+	std::chrono::nanoseconds get_time();
 
 	// Checks the status of the timer
 	bool is_started();
@@ -54,16 +64,46 @@ class Timer
 
 	private:
 	// The time when the timer startered
-	int startTicks;
+	std::chrono::steady_clock::time_point startTime;
 
 	// The ticks stored when the timer was paused
-	int pausedTicks;
+	std::chrono::nanoseconds pausedTime;
 
 	// The timer status
 	bool paused;
 	bool started;
 };
 
+// Holds frames to a fixed rate against a running deadline
+class FramePacer
+{
+	public:
+		// Sets the frame rate to pace to
+		FramePacer(int framesPerSecond);
+
+		// Sets the first deadline one frame from now
+		void start();
+
+		// Waits for the current deadline and moves it on by one frame
+		void wait();
+
+		// Gets the number of deadlines that had already passed when waited on
+		int get_missed();
+
+	private:
+		// The time since pacing started
+		Timer clock;
+
+		// The length of a frame in milliseconds
+		double frameLength;
+
+		// When the current frame should end
+		double deadline;
+
+		// The number of missed deadlines
+		int missed;
+};
+
 class Square
 {
 public:
@@ -85,7 +125,7 @@ private:
 
 int main(int argc, char *args[])
 {
-	Timer fps;
+	FramePacer fps(FRAMES_PER_SECOND);
 	Square mySquare;
 
 	bool quit = false;
@@ -106,11 +146,11 @@ int main(int argc, char *args[])
 	wall.w = 40;
 	wall.h = 400;
 
+	// Start pacing frames
+	fps.start();
+
 	while(quit == false)
 	{
-		// Start the frame timer
-		fps.start();
-
 		while(SDL_PollEvent(&event))
 		{
 			// Handle events for the square
@@ -140,10 +180,7 @@ int main(int argc, char *args[])
 		}
 
 		// Cap the frame rate
-		if(fps.get_ticks() < 1000 / FRAMES_PER_SECOND)
-		{
-			SDL_Delay((1000/FRAMES_PER_SECOND) - fps.get_ticks());
-		}
+		fps.wait();
 	}
 	clean_up();
 	return 0;
@@ -212,45 +249,83 @@ void clean_up()
 }
 
 
-bool check_collision(SDL_Rect A, SDL_Rect B)
+float sweep_collision(SDL_Rect A, int xVel, int yVel, SDL_Rect B, int &normalX, int &normalY)
 {
-	// The side of the rectangles
-	int leftA, leftB;
-	int rightA, rightB;
-	int topA, topB;
-	int bottomA, bottomB;
-
-	// Calculate the sides of rect A
-	leftA = A.x;
-	rightA = A.x + A.w;
-	topA = A.y;
-	bottomA = A.y + A.h;
-
-	// Calculate the sides of rect B
-	leftB = B.x;
-	rightB = B.x + B.w;
-	topB = B.y;
-	bottomB = B.y + B.h;
-
-	// If any of the sides from A are outside of B
-	if(bottomA <= topB)
+	// The times A's sides reach and leave B's sides on each axis, as fractions of the move
+	float xEntry, xExit;
+	float yEntry, yExit;
+
+	const float infinity = std::numeric_limits<float>::infinity();
+
+	// No contact yet
+	normalX = 0;
+	normalY = 0;
+
+	// Calculate when the horizontal sides meet
+	if(xVel > 0)
 	{
-		return false;
+		xEntry = (B.x - (A.x + A.w)) / (float)xVel;
+		xExit = ((B.x + B.w) - A.x) / (float)xVel;
 	}
-	if(topA >= bottomB)
+	else if(xVel < 0)
 	{
-		return false;
+		xEntry = ((B.x + B.w) - A.x) / (float)xVel;
+		xExit = (B.x - (A.x + A.w)) / (float)xVel;
 	}
-	if(rightA <= leftB)
+	// If A isn't moving horizontally it has to already be in line with B
+	else if((A.x + A.w <= B.x) || (A.x >= B.x + B.w))
 	{
-		return false;
+		return 1.f;
 	}
-	if(leftA >= rightB)
+	else
 	{
-		return false;
+		xEntry = -infinity;
+		xExit = infinity;
 	}
-	// If none of the side from A are outside B
-	return true;
+
+	// Calculate when the vertical sides meet
+	if(yVel > 0)
+	{
+		yEntry = (B.y - (A.y + A.h)) / (float)yVel;
+		yExit = ((B.y + B.h) - A.y) / (float)yVel;
+	}
+	else if(yVel < 0)
+	{
+		yEntry = ((B.y + B.h) - A.y) / (float)yVel;
+		yExit = (B.y - (A.y + A.h)) / (float)yVel;
+	}
+	// If A isn't moving vertically it has to already be in line with B
+	else if((A.y + A.h <= B.y) || (A.y >= B.y + B.h))
+	{
+		return 1.f;
+	}
+	else
+	{
+		yEntry = -infinity;
+		yExit = infinity;
+	}
+
+	// The boxes touch once they overlap on both axes and part once they stop overlapping on either
+	float entry = std::max(xEntry, yEntry);
+	float exit = std::min(xExit, yExit);
+
+	// If the boxes never overlap during this move, or were already overlapping before it
+	if((entry >= exit) || (entry < 0.f) || (entry >= 1.f))
+	{
+		return 1.f;
+	}
+
+	// The side that was hit last is the one in contact
+	if(xEntry > yEntry)
+	{
+		normalX = (xVel > 0) ? -1 : 1;
+	}
+	else
+	{
+		normalY = (yVel > 0) ? -1 : 1;
+	}
+
+	return entry;
 }
 
 
@@ -297,24 +372,67 @@ void Square::handle_input()
 
 void Square::move()
 {
-	// Move the square left or right
-	box.x += xVel;
+	// The part of the move still to be made
+	int moveX = xVel;
+	int moveY = yVel;
+
+	// The side of the wall that was hit
+	int normalX, normalY;
 
-	// If the square went too far too the left or right
-	if( (box.x < 0) || (box.x + SQUARE_WIDTH > SCREEN_WIDTH) || (check_collision(box, wall)))
+	// Move up to the wall, then slide along it with what's left
+	for(int pass = 0; (pass < 2) && ((moveX != 0) || (moveY != 0)); pass++)
 	{
-		// Move back
-		box.x -= xVel;
+		// Find when the square touches the wall
+		float time = sweep_collision(box, moveX, moveY, wall, normalX, normalY);
+
+		// Move as far as the contact point
+		int stepX = (int)(moveX * time);
+		int stepY = (int)(moveY * time);
+
+		// Snap flush against the side that was hit
+		if(normalX != 0)
+		{
+			stepX = (moveX > 0) ? wall.x - (box.x + box.w) : (wall.x + wall.w) - box.x;
+		}
+		else if(normalY != 0)
+		{
+			stepY = (moveY > 0) ? wall.y - (box.y + box.h) : (wall.y + wall.h) - box.y;
+		}
+
+		box.x += stepX;
+		box.y += stepY;
+		moveX -= stepX;
+		moveY -= stepY;
+
+		// Stop moving into the wall
+		if(normalX != 0)
+		{
+			moveX = 0;
+		}
+		else if(normalY != 0)
+		{
+			moveY = 0;
+		}
 	}
 
-	// Move the square up or down
-	box.y += yVel;
+	// If the square went too far to the left or right, stop at the edge
+	if(box.x < 0)
+	{
+		box.x = 0;
+	}
+	else if(box.x + SQUARE_WIDTH > SCREEN_WIDTH)
+	{
+		box.x = SCREEN_WIDTH - SQUARE_WIDTH;
+	}
 
-	// If the square went too far up or down
-	if( (box.y < 0) || (box.y + SQUARE_HEIGHT > SCREEN_HEIGHT) || (check_collision(box, wall)))
+	// If the square went too far up or down, stop at the edge
+	if(box.y < 0)
+	{
+		box.y = 0;
+	}
+	else if(box.y + SQUARE_HEIGHT > SCREEN_HEIGHT)
 	{
-		// Move back
-		box.y -= yVel;
+		box.y = SCREEN_HEIGHT - SQUARE_HEIGHT;
 	}
 }
 
@@ -327,8 +445,8 @@ void Square::show()
 Timer::Timer()
 {
 	// Initialize the variables
-	startTicks = 0;
-	pausedTicks = 0;
+	startTime = std::chrono::steady_clock::time_point();
+	pausedTime = std::chrono::nanoseconds::zero();
 	paused = false;
 	started = false;
 }
@@ -342,7 +460,7 @@ void Timer::start()
 	paused = false;
 
 	// Get the current clock time 
-	startTicks =SDL_GetTicks();	
+	startTime = std::chrono::steady_clock::now();
 }
 
 void Timer::stop()
@@ -355,7 +473,7 @@ void Timer::stop()
 
 }
 
-int Timer::get_ticks()
+std::chrono::nanoseconds Timer::get_time()
 {
 	// If the timer is running
 	if(started == true)
@@ -364,17 +482,23 @@ int Timer::get_ticks()
 		if(paused == true)
 		{
 			// Return the number of ticks when the timer was paused
-			return pausedTicks;
+			return pausedTime;
 		}
 		else
 		{
 			// Return the current time minus the start time
-			return SDL_GetTicks() - startTicks;	
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime);
 		}
 
 	}
 	// If the timer isn't running
-	return 0;
+	return std::chrono::nanoseconds::zero();
+}
+
+double Timer::get_ticks()
+{
+	// Convert the time to fractional milliseconds
+	return std::chrono::duration<double, std::milli>(get_time()).count();
 }
 
 void Timer::pause()
@@ -386,7 +510,7 @@ void Timer::pause()
 		paused = true;
 
 		// Calculate the paused ticks
-		pausedTicks = SDL_GetTicks() - startTicks;
+		pausedTime = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime);
 	}
 }
 
@@ -399,10 +523,10 @@ void Timer::unpause()
 		paused = false;
 
 		// Reset the starting ticks
-		startTicks = SDL_GetTicks() - pausedTicks;
+		startTime = std::chrono::steady_clock::now() - pausedTime;
 
 		// Reset the paused ticks
-		pausedTicks = 0;
+		pausedTime = std::chrono::nanoseconds::zero();
 	}
 }
 
@@ -415,3 +539,57 @@ bool Timer::is_paused()
 {
 	return paused;
 }
+
+FramePacer::FramePacer(int framesPerSecond)
+{
+	// Initialize the variables
+	frameLength = 1000.0 / framesPerSecond;
+	deadline = 0;
+	missed = 0;
+}
+
+void FramePacer::start()
+{
+	// Start the clock with the first frame due one frame from now
+	clock.start();
+	deadline = frameLength;
+}
+
+void FramePacer::wait()
+{
+	double now = clock.get_ticks();
+
+	// If the frame ran past its deadline
+	if(now > deadline)
+	{
+		missed++;
+
+		// If it's a whole frame behind, start over from now instead of rushing to catch up
+		if(now - deadline >= frameLength)
+		{
+			deadline = now;
+		}
+	}
+	else
+	{
+		// Sleep through most of the wait, the OS may wake us late
+		if(deadline - now > PACER_SPIN_TIME)
+		{
+			SDL_Delay((Uint32)(deadline - now - PACER_SPIN_TIME));
+		}
+
+		// Spin out the rest against the clock
+		while(clock.get_ticks() < deadline)
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	// The next deadline is one frame after this one, so lateness doesn't add up
+	deadline += frameLength;
+}
+
+int FramePacer::get_missed()
+{
+	return missed;
+}
@@ -1,5 +1,7 @@
 #include <iostream>
 #include <string>
+#include <chrono>
+#include <thread>
 #include <sstream>
 #include "SDL.h"
 #include "SDL_image.h"
@@ -11,6 +13,9 @@ const int SCREEN_WIDTH = 640;
 const int SCREEN_HEIGHT = 480;
 const int SCREEN_BPP = 32;
 
+// How long before a deadline the frame pacer stops sleeping and spins, in milliseconds
+const double PACER_SPIN_TIME = 2.0;
+
 // Event
 SDL_Event event;
 
@@ -41,12 +46,43 @@ public:
 	void unpause();
 	bool is_started();
 	bool is_paused();
-	int get_ticks();
+	double get_ticks();
+	std::chrono::nanoseconds get_time();
 private:
 	bool paused;
 	bool started;
-	int pausedTicks;
-	int startTicks;
+	std::chrono::nanoseconds pausedTime;
+	std::chrono::steady_clock::time_point startTime;
+};
+
+// Holds frames to a fixed rate against a running deadline
+class FramePacer
+{
+	public:
+		// Sets the frame rate to pace to
+		FramePacer(int framesPerSecond);
+
+		// Sets the first deadline one frame from now
+		void start();
+
+		// Waits for the current deadline and moves it on by one frame
+		void wait();
+
+		// Gets the number of deadlines that had already passed when waited on
+		int get_missed();
+
+	private:
+		// The time since pacing started
+		Timer clock;
+
+		// The length of a frame in milliseconds
+		double frameLength;
+
+		// When the current frame should end
+		double deadline;
+
+		// The number of missed deadlines
+		int missed;
 };
 
 
@@ -61,7 +97,10 @@ int main(int argc, char *args[])
 	bool cap = true;
 
 	// The frame rate regulator
-	Timer fps;
+	FramePacer fps(FRAMES_PER_SECOND);
+
+	// The missed frames last shown in the caption
+	int missed = 0;
 
 	if(init() == false)
 	{
@@ -76,12 +115,12 @@ int main(int argc, char *args[])
 	// Generate the message surfaces
 	message = TTF_RenderText_Solid(font, "Testing Frame Rate", textColor);
 
+	// Start pacing frames
+	fps.start();
+
 	// While the user hasn't quit
 	while(quit == false)
 	{
-		// Start the frame timer
-		fps.start();
-
 		// While the user hasn't quit
 		while(SDL_PollEvent(&event))
 		{
@@ -93,6 +132,12 @@ int main(int argc, char *args[])
 				{
 					//Switch cap
 					cap = (!cap);
+
+					// Restart the deadlines rather than counting the uncapped frames as missed
+					if(cap == true)
+					{
+						fps.start();
+					}
 				}
 
 			}
@@ -118,10 +163,20 @@ int main(int argc, char *args[])
 		frame++;
 
 		// If we want to cap the frame rate
-		if((cap == true) && (fps.get_ticks() < 1000 / FRAMES_PER_SECOND))
+		if(cap == true)
 		{
-			// Sleeping the remaining frame time
-			SDL_Delay((1000/FRAMES_PER_SECOND) - fps.get_ticks());
+			// Wait out the remaining frame time
+			fps.wait();
+
+			// If more deadlines were missed, show how many
+			if(fps.get_missed() != missed)
+			{
+				missed = fps.get_missed();
+
+				std::stringstream caption;
+				caption << "Frame Limit - Missed Frames: " << missed;
+				SDL_WM_SetCaption(caption.str().c_str(), NULL);
+			}
 		}
 	}
 	clean_up();
@@ -205,15 +260,15 @@ Timer::Timer()
 {
 	paused = false;
 	started = false;
-	pausedTicks = 0;
-	startTicks = 0;
+	pausedTime = std::chrono::nanoseconds::zero();
+	startTime = std::chrono::steady_clock::time_point();
 }
 
 void Timer::start()
 {
 	started = true;
 	paused = false;
-	startTicks = SDL_GetTicks();
+	startTime = std::chrono::steady_clock::now();
 }
 
 void Timer::stop()
@@ -222,20 +277,25 @@ void Timer::stop()
 	paused = false;
 }
 
-int Timer::get_ticks()
+std::chrono::nanoseconds Timer::get_time()
 {
 	if(started == true)
 	{
 		if(paused == true)
 		{
-			return pausedTicks;
+			return pausedTime;
 		}
 		else
 		{
-			return SDL_GetTicks() - startTicks;
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime);
 		}
 	}
-	return 0;
+	return std::chrono::nanoseconds::zero();
+}
+
+double Timer::get_ticks()
+{
+	return std::chrono::duration<double, std::milli>(get_time()).count();
 }
 
 void Timer::unpause()
@@ -243,8 +303,8 @@ void Timer::unpause()
 	if(paused == true)
 	{
 		paused = false;
-		startTicks = SDL_GetTicks() - pausedTicks;
-		pausedTicks = 0;
+		startTime = std::chrono::steady_clock::now() - pausedTime;
+		pausedTime = std::chrono::nanoseconds::zero();
 	}
 }
 
@@ -263,7 +323,60 @@ void Timer::pause()
 	if((started == true)&&(paused == false))
 	{
 		paused = true;
-		pausedTicks = SDL_GetTicks() - startTicks;
+		pausedTime = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime);
+	}
+}
+
+FramePacer::FramePacer(int framesPerSecond)
+{
+	// Initialize the variables
+	frameLength = 1000.0 / framesPerSecond;
+	deadline = 0;
+	missed = 0;
+}
+
+void FramePacer::start()
+{
+	// Start the clock with the first frame due one frame from now
+	clock.start();
+	deadline = frameLength;
+}
+
+void FramePacer::wait()
+{
+	double now = clock.get_ticks();
+
+	// If the frame ran past its deadline
+	if(now > deadline)
+	{
+		missed++;
+
+		// If it's a whole frame behind, start over from now instead of rushing to catch up
+		if(now - deadline >= frameLength)
+		{
+			deadline = now;
+		}
+	}
+	else
+	{
+		// Sleep through most of the wait, the OS may wake us late
+		if(deadline - now > PACER_SPIN_TIME)
+		{
+			SDL_Delay((Uint32)(deadline - now - PACER_SPIN_TIME));
+		}
+
+		// Spin out the rest against the clock
+		while(clock.get_ticks() < deadline)
+		{
+			std::this_thread::yield();
+		}
 	}
+
+	// The next deadline is one frame after this one, so lateness doesn't add up
+	deadline += frameLength;
 }
 
+int FramePacer::get_missed()
+{
+	return missed;
+}
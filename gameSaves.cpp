@@ -1,6 +1,8 @@
 // Headers
 #include <iostream>
 #include <string>
+#include <chrono>
+#include <thread>
 #include <fstream>
 #include "SDL/SDL.h"
 #include "SDL/SDL_image.h"
@@ -13,6 +15,9 @@ const int DOT_HEIGHT = 40;
 const int DOT_WIDTH = 37;
 const int FRAMES_PER_SECOND = 20;
 
+// How long before a deadline the frame pacer stops sleeping and spins, in milliseconds
+const double PACER_SPIN_TIME = 2.0;
+
 // Surfaces
 SDL_Surface *screen = NULL;
 SDL_Surface *dot = NULL;
@@ -34,8 +39,11 @@ class Timer
 		void pause();
 		void unpause();
 
-		// Get the timer's time
-		int get_ticks();
+		// Get the timer's time in milliseconds
+		double get_ticks();
+
+		// Get the timer's time at full resolution
+		std::chrono::nanoseconds get_time();
 
 		// Checks the status of the timer
 		bool is_started();
@@ -43,16 +51,46 @@ class Timer
 
 	private:
 		// The time when the timer startered
-		int startTicks;
+		std::chrono::steady_clock::time_point startTime;
 
 		// The ticks stored when the timer was paused
-		int pausedTicks;
+		std::chrono::nanoseconds pausedTime;
 
 		// The timer status
 		bool paused;
 		bool started;
 };
 
+// Holds frames to a fixed rate against a running deadline
+class FramePacer
+{
+	public:
+		// Sets the frame rate to pace to
+		FramePacer(int framesPerSecond);
+
+		// Sets the first deadline one frame from now
+		void start();
+
+		// Waits for the current deadline and moves it on by one frame
+		void wait();
+
+		// Gets the number of deadlines that had already passed when waited on
+		int get_missed();
+
+	private:
+		// The time since pacing started
+		Timer clock;
+
+		// The length of a frame in milliseconds
+		double frameLength;
+
+		// When the current frame should end
+		double deadline;
+
+		// The number of missed deadlines
+		int missed;
+};
+
 class Dot
 {
 	public:
@@ -88,7 +126,7 @@ void clean_up(Dot &thisDot, Uint32 &bg);
 int main(int argc, char *args[])
 {
 	// Class instances
-	Timer fps;
+	FramePacer fps(FRAMES_PER_SECOND);
 	Dot myDot;
 	
 	// Quit flag
@@ -109,12 +147,12 @@ int main(int argc, char *args[])
 		return 2;
 	}
 
+	// Start pacing frames
+	fps.start();
+
 	// Whilte flag has not been set
 	while(quit == false)
 	{
-		// Start the frame timer
-		fps.start();
-
 		while(SDL_PollEvent(&event))
 		{
 			// Handle events for the dot
@@ -159,10 +197,7 @@ int main(int argc, char *args[])
 		}
 
 		// Cap the frame rate
-		if(fps.get_ticks() < 1000 / FRAMES_PER_SECOND)
-		{
-			SDL_Delay((1000/FRAMES_PER_SECOND) - fps.get_ticks());
-		}
+		fps.wait();
 	}
 	// Clean up surfaces, save game info and close SDL
 	clean_up(myDot, background);
@@ -216,7 +251,7 @@ bool load_files(Dot &thisDot, Uint32 &bg)
 	// Open a file for reading
 	std::ifstream load("game_save");
 	// If the file loaded
-	if(load != NULL)
+	if(load.fail() == false)
 	{
 		// The offset
 		int offset;
@@ -410,8 +445,8 @@ int Dot::get_y()
 Timer::Timer()
 {
 	// Initialize the variables
-	startTicks = 0;
-	pausedTicks = 0;
+	startTime = std::chrono::steady_clock::time_point();
+	pausedTime = std::chrono::nanoseconds::zero();
 	paused = false;
 	started = false;
 }
@@ -425,7 +460,7 @@ void Timer::start()
 	paused = false;
 
 	// Get the current clock time 
-	startTicks =SDL_GetTicks();	
+	startTime = std::chrono::steady_clock::now();
 }
 
 void Timer::stop()
@@ -438,7 +473,7 @@ void Timer::stop()
 
 }
 
-int Timer::get_ticks()
+std::chrono::nanoseconds Timer::get_time()
 {
 	// If the timer is running
 	if(started == true)
@@ -447,17 +482,23 @@ int Timer::get_ticks()
 		if(paused == true)
 		{
 			// Return the number of ticks when the timer was paused
-			return pausedTicks;
+			return pausedTime;
 		}
 		else
 		{
 			// Return the current time minus the start time
-			return SDL_GetTicks() - startTicks;	
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime);
 		}
 
 	}
 	// If the timer isn't running
-	return 0;
+	return std::chrono::nanoseconds::zero();
+}
+
+double Timer::get_ticks()
+{
+	// Convert the time to fractional milliseconds
+	return std::chrono::duration<double, std::milli>(get_time()).count();
 }
 
 void Timer::pause()
@@ -469,7 +510,7 @@ void Timer::pause()
 		paused = true;
 
 		// Calculate the paused ticks
-		pausedTicks = SDL_GetTicks() - startTicks;
+		pausedTime = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime);
 	}
 }
 
@@ -482,10 +523,10 @@ void Timer::unpause()
 		paused = false;
 
 		// Reset the starting ticks
-		startTicks = SDL_GetTicks() - pausedTicks;
+		startTime = std::chrono::steady_clock::now() - pausedTime;
 
 		// Reset the paused ticks
-		pausedTicks = 0;
+		pausedTime = std::chrono::nanoseconds::zero();
 	}
 }
 
@@ -498,3 +539,57 @@ bool Timer::is_paused()
 {
 	return paused;
 }
+
+FramePacer::FramePacer(int framesPerSecond)
+{
+	// Initialize the variables
+	frameLength = 1000.0 / framesPerSecond;
+	deadline = 0;
+	missed = 0;
+}
+
+void FramePacer::start()
+{
+	// Start the clock with the first frame due one frame from now
+	clock.start();
+	deadline = frameLength;
+}
+
+void FramePacer::wait()
+{
+	double now = clock.get_ticks();
+
+	// If the frame ran past its deadline
+	if(now > deadline)
+	{
+		missed++;
+
+		// If it's a whole frame behind, start over from now instead of rushing to catch up
+		if(now - deadline >= frameLength)
+		{
+			deadline = now;
+		}
+	}
+	else
+	{
+		// Sleep through most of the wait, the OS may wake us late
+		if(deadline - now > PACER_SPIN_TIME)
+		{
+			SDL_Delay((Uint32)(deadline - now - PACER_SPIN_TIME));
+		}
+
+		// Spin out the rest against the clock
+		while(clock.get_ticks() < deadline)
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	// The next deadline is one frame after this one, so lateness doesn't add up
+	deadline += frameLength;
+}
+
+int FramePacer::get_missed()
+{
+	return missed;
+}
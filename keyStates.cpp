@@ -6,6 +6,8 @@
 
 #include <iostream>
 #include <string>
+#include <list>
+#include <map>
 #include "SDL.h"
 #include "SDL_Image.h"
 #include "SDL_ttf.h"
@@ -16,13 +18,12 @@ const int SCREEN_WIDTH = 640;
 const int SCREEN_HEIGHT = 480;
 const int SCREEN_BPP = 32;
 
+// The most bytes of rendered text kept around
+const int TEXT_CACHE_BUDGET = 1024 * 1024;
+
 // Surface
 SDL_Surface* screen = NULL;
 SDL_Surface* image = NULL;
-SDL_Surface* up = NULL;
-SDL_Surface* down = NULL;
-SDL_Surface* left = NULL;
-SDL_Surface* right = NULL;
 
 // Events
 SDL_Event event;
@@ -31,6 +32,66 @@ SDL_Event event;
 TTF_Font *font = NULL;
 SDL_Color textColor = {0, 0, 0};
 
+// Rendered text surfaces kept by font, string and color, least recently used are freed once over the memory budget
+class TextCache
+{
+	public:
+		// Sets the memory budget in bytes
+		TextCache(int budget);
+
+		// Gets the rendered string, rendering it on a miss. The surface belongs to the cache and stays valid until the next get
+		SDL_Surface *get(TTF_Font *font, std::string text, SDL_Color color);
+
+		// Frees every cached surface
+		void clear();
+
+		// Gets the lookup counters
+		int get_hits();
+		int get_misses();
+
+		// Gets the bytes of pixels held
+		int get_bytes();
+
+	private:
+		// What a rendered string is looked up by
+		struct Key
+		{
+			TTF_Font *font;
+			Uint32 color;
+			std::string text;
+
+			bool operator<(const Key &other) const;
+		};
+
+		// A rendered string
+		struct Entry
+		{
+			Key key;
+			SDL_Surface *surface;
+			int bytes;
+		};
+
+		// The entries, most recently used first
+		std::list<Entry> entries;
+
+		// Where each key's entry is in the list
+		std::map<Key, std::list<Entry>::iterator> lookup;
+
+		// The memory budget and use
+		int budget;
+		int bytes;
+
+		// The lookup counters
+		int hits;
+		int misses;
+
+		// Frees least recently used entries until under budget, keeping the most recent one
+		void evict();
+};
+
+// The rendered labels
+TextCache labels(TEXT_CACHE_BUDGET);
+
 // Prototypes
 bool init();
 bool load_files();
@@ -56,13 +117,6 @@ int main(int argc, char* args[])
 		return 1;
 	}
 
-
-	// Set us up the text
-	up = TTF_RenderText_Solid(font, "Up" , textColor);
-	down = TTF_RenderText_Solid(font, "Down" , textColor);
-	left = TTF_RenderText_Solid(font, "Left" , textColor);
-	right = TTF_RenderText_Solid(font, "Right" , textColor);
-
 	// While the user has not quit
 	while( quit == false)
 	{
@@ -86,23 +140,43 @@ int main(int argc, char* args[])
 		// If up is pressed
 		if(keystates[SDLK_UP])
 		{
+			SDL_Surface *up = labels.get(font, "Up", textColor);
+			if(up == NULL)
+			{
+				return 1;
+			}
 			apply_surface((SCREEN_WIDTH - up->w)/2,(SCREEN_HEIGHT/2 - up->h)/2, up, screen);
 		}
 
 		// If down is pressed
 		if(keystates[SDLK_DOWN])
 		{
+			SDL_Surface *down = labels.get(font, "Down", textColor);
+			if(down == NULL)
+			{
+				return 1;
+			}
 			apply_surface((SCREEN_WIDTH - down->w)/2,(SCREEN_HEIGHT/2 - down->h)/2 + (SCREEN_HEIGHT / 2), down, screen);
 		}
 
 		// If left is pressed
 		if(keystates[SDLK_LEFT])
 		{
+			SDL_Surface *left = labels.get(font, "Left", textColor);
+			if(left == NULL)
+			{
+				return 1;
+			}
 			apply_surface((SCREEN_WIDTH/2 - left->w)/2, (SCREEN_HEIGHT - left->h)/2, left, screen);
 		}
 		// If right is pressed
 		if(keystates[SDLK_RIGHT])
 		{
+			SDL_Surface *right = labels.get(font, "Right", textColor);
+			if(right == NULL)
+			{
+				return 1;
+			}
 			apply_surface((SCREEN_WIDTH/2 - right->w)/2 + (SCREEN_WIDTH/2), (SCREEN_HEIGHT - right->h)/2, right, screen);
 		}
 
@@ -213,10 +287,10 @@ void clean_up()
 {
 	// Memory leak bad
 	SDL_FreeSurface(image);
-	SDL_FreeSurface(up);
-	SDL_FreeSurface(down);
-	SDL_FreeSurface(left);
-	SDL_FreeSurface(right);
+
+	// Say how well the text cache did before it's emptied
+	std::cerr << "Text cache: " << labels.get_hits() << " hits, " << labels.get_misses() << " misses, " << labels.get_bytes() << " bytes held" << std::endl;
+	labels.clear();
 
 	// Plug font leak
 	TTF_CloseFont(font);
@@ -225,3 +299,109 @@ void clean_up()
 	// Quit SDL
 	SDL_Quit();
 }
+
+TextCache::TextCache(int budget)
+{
+	// Initialize the variables
+	this->budget = budget;
+	bytes = 0;
+	hits = 0;
+	misses = 0;
+}
+
+bool TextCache::Key::operator<(const Key &other) const
+{
+	if(font != other.font)
+	{
+		return font < other.font;
+	}
+	if(color != other.color)
+	{
+		return color < other.color;
+	}
+	return text < other.text;
+}
+
+SDL_Surface *TextCache::get(TTF_Font *font, std::string text, SDL_Color color)
+{
+	Key key;
+	key.font = font;
+	key.color = (color.r << 16) | (color.g << 8) | color.b;
+	key.text = text;
+
+	// If the string has been rendered already
+	std::map<Key, std::list<Entry>::iterator>::iterator found = lookup.find(key);
+	if(found != lookup.end())
+	{
+		hits++;
+
+		// Move it to the front as the most recently used
+		entries.splice(entries.begin(), entries, found->second);
+		return found->second->surface;
+	}
+
+	misses++;
+
+	// Render the string
+	SDL_Surface *surface = TTF_RenderText_Solid(font, text.c_str(), color);
+
+	// If there was an error rendering the text
+	if(surface == NULL)
+	{
+		return NULL;
+	}
+
+	// Keep it at the front
+	Entry entry;
+	entry.key = key;
+	entry.surface = surface;
+	entry.bytes = surface->pitch * surface->h;
+	entries.push_front(entry);
+	lookup[key] = entries.begin();
+	bytes += entry.bytes;
+
+	// Make room for it
+	evict();
+
+	return surface;
+}
+
+void TextCache::evict()
+{
+	// Free from the back until under budget, never the entry just used
+	while((bytes > budget) && (entries.size() > 1))
+	{
+		Entry &last = entries.back();
+		bytes -= last.bytes;
+		SDL_FreeSurface(last.surface);
+		lookup.erase(last.key);
+		entries.pop_back();
+	}
+}
+
+void TextCache::clear()
+{
+	// Free the surfaces
+	for(std::list<Entry>::iterator entry = entries.begin(); entry != entries.end(); entry++)
+	{
+		SDL_FreeSurface(entry->surface);
+	}
+	entries.clear();
+	lookup.clear();
+	bytes = 0;
+}
+
+int TextCache::get_hits()
+{
+	return hits;
+}
+
+int TextCache::get_misses()
+{
+	return misses;
+}
+
+int TextCache::get_bytes()
+{
+	return bytes;
+}
@@ -0,0 +1,313 @@
+/* Map packer.
+   Cuts a level image into tiles, keeps one copy of each different tile on a tileset, and writes the level as a grid
+   of tile numbers in square chunks, so a sample can draw just the chunks the camera is over.
+
+   mapPacker [-tile N] [-chunk N] input.png output
+
+   Writes output.bmp, the tileset, and output.map. Tiles that are all the color key are left empty.
+*/
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "SDL.h"
+#include "SDL_image.h"
+
+// The default width and height of a tile in pixels, and of a chunk in tiles
+const int MAP_TILE_SIZE = 32;
+const int MAP_CHUNK_TILES = 16;
+
+// The number of tiles across the tileset
+const int TILESET_COLUMNS = 16;
+
+// The tile number of a tile with nothing in it
+const Uint16 MAP_EMPTY = 0xFFFF;
+
+// The first bytes of a map file
+const char MAP_MAGIC[4] = {'M', 'A', 'P', '1'};
+
+// The header at the start of a map file, followed by the chunks left to right then top to bottom,
+// each a chunk's worth of Uint16 tile numbers a row at a time, padded out with empty tiles at the level's edges
+struct MapHeader
+{
+	// MAP_MAGIC
+	char magic[4];
+
+	// The size of a tile in pixels and of a chunk in tiles
+	Uint32 tileSize;
+	Uint32 chunkTiles;
+
+	// The size of the level in tiles, and in chunks
+	Uint32 width, height;
+	Uint32 chunksAcross, chunksDown;
+
+	// Where the chunks start in the file
+	Uint32 chunkOffset;
+
+	// The tileset image, found next to the map
+	char tileset[64];
+};
+
+// Loads an image into the 32 bit format the tileset uses, copying the pixels straight
+SDL_Surface *load_image(std::string filename)
+{
+	SDL_Surface *loadedImage = IMG_Load(filename.c_str());
+	if(loadedImage == NULL)
+	{
+		return NULL;
+	}
+
+	SDL_Surface *converted = SDL_CreateRGBSurface(SDL_SWSURFACE, loadedImage->w, loadedImage->h, 32, 0x00FF0000, 0x0000FF00, 0x000000FF, 0);
+	if(converted != NULL)
+	{
+		SDL_SetAlpha(loadedImage, 0, 0);
+		SDL_SetColorKey(loadedImage, 0, 0);
+		SDL_BlitSurface(loadedImage, NULL, converted, NULL);
+	}
+
+	SDL_FreeSurface(loadedImage);
+	return converted;
+}
+
+int main(int argc, char *args[])
+{
+	int tileSize = MAP_TILE_SIZE;
+	int chunkTiles = MAP_CHUNK_TILES;
+	int first = 1;
+
+	// Read the tile and chunk sizes
+	while((first + 1 < argc) && (args[first][0] == '-'))
+	{
+		if(strcmp(args[first], "-tile") == 0)
+		{
+			tileSize = atoi(args[first + 1]);
+		}
+		else if(strcmp(args[first], "-chunk") == 0)
+		{
+			chunkTiles = atoi(args[first + 1]);
+		}
+		else
+		{
+			break;
+		}
+		first += 2;
+	}
+
+	if((argc - first != 2) || (tileSize <= 0) || (chunkTiles <= 0))
+	{
+		std::cerr << "Usage: mapPacker [-tile N] [-chunk N] input.png output" << std::endl;
+		return 1;
+	}
+
+	std::string output = args[first + 1];
+
+	// No window is needed, only the image loader
+	if(SDL_Init(0) == -1)
+	{
+		return 2;
+	}
+
+	SDL_Surface *image = load_image(args[first]);
+	if(image == NULL)
+	{
+		std::cerr << "Couldn't load " << args[first] << std::endl;
+		SDL_Quit();
+		return 3;
+	}
+
+	Uint32 key = SDL_MapRGB(image->format, 0, 0xFF, 0xFF);
+
+	// The level in tiles, a part tile at the right or bottom edge is filled out with the key
+	int width = (image->w + tileSize - 1) / tileSize;
+	int height = (image->h + tileSize - 1) / tileSize;
+
+	// The tile number of each place in the level, and the pixels of each different tile
+	std::vector<Uint16> level(width * height, MAP_EMPTY);
+	std::vector<std::string> tiles;
+	std::map<std::string, Uint16> numbers;
+
+	std::vector<Uint32> pixels(tileSize * tileSize);
+
+	SDL_LockSurface(image);
+	for(int ty = 0; ty < height; ty++)
+	{
+		for(int tx = 0; tx < width; tx++)
+		{
+			// Copy the tile out, keying what's past the edge
+			bool empty = true;
+			for(int y = 0; y < tileSize; y++)
+			{
+				for(int x = 0; x < tileSize; x++)
+				{
+					int px = tx * tileSize + x;
+					int py = ty * tileSize + y;
+
+					Uint32 pixel = key;
+					if((px < image->w) && (py < image->h))
+					{
+						pixel = ((Uint32 *)((Uint8 *)image->pixels + py * image->pitch))[px];
+					}
+
+					pixels[y * tileSize + x] = pixel;
+					if(pixel != key)
+					{
+						empty = false;
+					}
+				}
+			}
+
+			if(empty == true)
+			{
+				continue;
+			}
+
+			// Use the tile already on the tileset if it's been seen
+			std::string tile((char *)&pixels[0], pixels.size() * sizeof(Uint32));
+			std::map<std::string, Uint16>::iterator found = numbers.find(tile);
+			if(found != numbers.end())
+			{
+				level[ty * width + tx] = found->second;
+				continue;
+			}
+
+			if(tiles.size() >= MAP_EMPTY)
+			{
+				std::cerr << "Too many different tiles" << std::endl;
+				SDL_UnlockSurface(image);
+				SDL_FreeSurface(image);
+				SDL_Quit();
+				return 4;
+			}
+
+			Uint16 number = tiles.size();
+			numbers[tile] = number;
+			tiles.push_back(tile);
+			level[ty * width + tx] = number;
+		}
+	}
+	SDL_UnlockSurface(image);
+	SDL_FreeSurface(image);
+
+	// Lay the tiles out on the tileset in rows
+	int columns = std::min((int)tiles.size(), TILESET_COLUMNS);
+	int rows = (tiles.size() + TILESET_COLUMNS - 1) / TILESET_COLUMNS;
+	if(columns == 0)
+	{
+		columns = 1;
+		rows = 1;
+	}
+
+	SDL_Surface *tileset = SDL_CreateRGBSurface(SDL_SWSURFACE, columns * tileSize, rows * tileSize, 32, 0x00FF0000, 0x0000FF00, 0x000000FF, 0);
+	if(tileset == NULL)
+	{
+		SDL_Quit();
+		return 5;
+	}
+	SDL_FillRect(tileset, NULL, key);
+
+	SDL_LockSurface(tileset);
+	for(unsigned int i = 0; i < tiles.size(); i++)
+	{
+		const Uint32 *tile = (const Uint32 *)tiles[i].data();
+		int left = (i % TILESET_COLUMNS) * tileSize;
+		int top = (i / TILESET_COLUMNS) * tileSize;
+
+		for(int y = 0; y < tileSize; y++)
+		{
+			memcpy((Uint8 *)tileset->pixels + (top + y) * tileset->pitch + left * 4, tile + y * tileSize, tileSize * 4);
+		}
+	}
+	SDL_UnlockSurface(tileset);
+
+	// The tileset is found next to the map
+	std::string tilesetFile = output + ".bmp";
+	std::string tilesetName = tilesetFile;
+	size_t slash = tilesetName.find_last_of("/\\");
+	if(slash != std::string::npos)
+	{
+		tilesetName = tilesetName.substr(slash + 1);
+	}
+
+	// Fill in the header
+	MapHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, MAP_MAGIC, sizeof(header.magic));
+	header.tileSize = tileSize;
+	header.chunkTiles = chunkTiles;
+	header.width = width;
+	header.height = height;
+	header.chunksAcross = (width + chunkTiles - 1) / chunkTiles;
+	header.chunksDown = (height + chunkTiles - 1) / chunkTiles;
+	header.chunkOffset = sizeof(header);
+
+	if(tilesetName.size() >= sizeof(header.tileset))
+	{
+		std::cerr << "Tileset name " << tilesetName << " is too long" << std::endl;
+		SDL_FreeSurface(tileset);
+		SDL_Quit();
+		return 1;
+	}
+	strcpy(header.tileset, tilesetName.c_str());
+
+	if(SDL_SaveBMP(tileset, tilesetFile.c_str()) == -1)
+	{
+		std::cerr << "Couldn't write " << tilesetFile << std::endl;
+		SDL_FreeSurface(tileset);
+		SDL_Quit();
+		return 6;
+	}
+	SDL_FreeSurface(tileset);
+
+	std::ofstream file((output + ".map").c_str(), std::ios::binary);
+	if(file.fail() == true)
+	{
+		std::cerr << "Couldn't open " << output << ".map" << std::endl;
+		SDL_Quit();
+		return 6;
+	}
+
+	file.write((char *)&header, sizeof(header));
+
+	// Write the chunks a row of tiles at a time
+	std::vector<Uint16> chunk(chunkTiles * chunkTiles);
+	for(Uint32 cy = 0; cy < header.chunksDown; cy++)
+	{
+		for(Uint32 cx = 0; cx < header.chunksAcross; cx++)
+		{
+			for(int y = 0; y < chunkTiles; y++)
+			{
+				for(int x = 0; x < chunkTiles; x++)
+				{
+					int tx = cx * chunkTiles + x;
+					int ty = cy * chunkTiles + y;
+
+					chunk[y * chunkTiles + x] = MAP_EMPTY;
+					if((tx < width) && (ty < height))
+					{
+						chunk[y * chunkTiles + x] = level[ty * width + tx];
+					}
+				}
+			}
+			file.write((char *)&chunk[0], chunk.size() * sizeof(Uint16));
+		}
+	}
+
+	bool failed = file.fail();
+	file.close();
+	SDL_Quit();
+
+	if(failed == true)
+	{
+		std::cerr << "Couldn't write " << output << ".map" << std::endl;
+		return 6;
+	}
+
+	std::cout << width << "x" << height << " tiles, " << tiles.size() << " different" << std::endl;
+	return 0;
+}
@@ -1,6 +1,11 @@
 // Headers
 #include <iostream>
 #include <string>
+#include <chrono>
+#include <thread>
+#include <cmath>
+#include <vector>
+#include <algorithm>
 #include "SDL.h"
 #include "SDL_image.h"
 
@@ -12,7 +17,20 @@ const int SCREEN_BPP = 32;
 const int DOT_HEIGHT = 40;
 const int DOT_WIDTH = 37;
 
-const int FRAMES_PER_SECOND = 20;
+// The simulation rate, rendering runs as fast as it can in between
+const int TICKS_PER_SECOND = 20;
+
+// The most ticks run in one frame before the simulation gives up catching up
+const int MAX_TICKS_PER_FRAME = 5;
+
+// The rendering rate, frames are drawn between ticks
+const int FRAMES_PER_SECOND = 60;
+
+// How long before a deadline the frame pacer stops sleeping and spins, in milliseconds
+const double PACER_SPIN_TIME = 2.0;
+
+// The most changed areas kept apart before they're merged into one
+const unsigned int DIRTY_MAX_RECTS = 32;
 
 // Prototypes
 bool init();
@@ -41,8 +59,11 @@ class Timer
 	void pause();
 	void unpause();
 
-	// Get the timer's time
-	int get_ticks();
+	// Get the timer's time in milliseconds
+	double get_ticks();
+
+	// Get the timer's time at full resolution
+	std::chrono::nanoseconds get_time();
 
 	// Checks the status of the timer
 	bool is_started();
@@ -50,16 +71,95 @@ class Timer
 
 	private:
 	// The time when the timer startered
-	int startTicks;
+	std::chrono::steady_clock::time_point startTime;
 
 	// The ticks stored when the timer was paused
-	int pausedTicks;
+	std::chrono::nanoseconds pausedTime;
 
 	// The timer status
 	bool paused;
 	bool started;
 };
 
+// Holds frames to a fixed rate against a running deadline
+class FramePacer
+{
+	public:
+		// Sets the frame rate to pace to
+		FramePacer(int framesPerSecond);
+
+		// Sets the first deadline one frame from now
+		void start();
+
+		// Waits for the current deadline and moves it on by one frame
+		void wait();
+
+		// Gets the number of deadlines that had already passed when waited on
+		int get_missed();
+
+	private:
+		// The time since pacing started
+		Timer clock;
+
+		// The length of a frame in milliseconds
+		double frameLength;
+
+		// When the current frame should end
+		double deadline;
+
+		// The number of missed deadlines
+		int missed;
+};
+
+// Tracks the parts of the screen that changed this frame so only they are redrawn and pushed
+class DirtyRects
+{
+public:
+	// Marks an area of the screen as changed
+	void add(SDL_Rect rect);
+
+	// Gets the changed areas, none of them overlap
+	int get_count();
+	SDL_Rect get(int i);
+
+	// Pushes the changed areas to the screen and starts the next frame with none
+	void update(SDL_Surface *screen);
+
+private:
+	// The changed areas
+	std::vector<SDL_Rect> rects;
+};
+
+// Runs the simulation at a fixed tick no matter how fast frames are rendered
+class FixedStep
+{
+public:
+	// Sets the number of ticks to run each second
+	FixedStep(int ticksPerSecond);
+
+	// Starts counting time
+	void start();
+
+	// Collects the time since the last frame and gets how many ticks to run
+	int advance();
+
+	// Gets how far the current frame is between the last tick and the next, from 0 to 1
+	float get_alpha();
+
+private:
+	// The time since the loop started
+	Timer clock;
+
+	// The length of a tick in milliseconds
+	double tickLength;
+
+	// The clock time at the last frame
+	double lastTicks;
+
+	// The time built up that hasn't been simulated yet
+	double accumulator;
+};
+
 class Dot
 {
 public:
@@ -67,25 +167,38 @@ public:
 	Dot();
 	// Takes the key presses and adjusts the dot's velocity
 	void handle_input();
-	// Move the dot
+	// Move the dot one tick
 	void move();
-	// Shows the dot on the screen
+	// Places the dot between its last two ticks and marks where it was and is as changed
+	void place(float alpha, DirtyRects &dirty);
+	// Shows the dot where it was last placed
 	void show();
 
 private:
 	// The X and Y offsets of the dot
 	int x, y;
+	// The offsets at the previous tick
+	int prevX, prevY;
 	// The velocity of the dot
 	int xVel, yVel;
+	// The offsets the dot is shown at
+	int showX, showY;
 };
 
 
 
 int main(int argc, char *args[])
 {
-	Timer fps;
+	// The simulation clock
+	FixedStep step(TICKS_PER_SECOND);
+
+	// The frame rate regulator
+	FramePacer fps(FRAMES_PER_SECOND);
 	Dot myDot;
 
+	// The parts of the screen to redraw
+	DirtyRects dirty;
+
 	bool quit = false;
 
 	if(init() == false)
@@ -98,11 +211,17 @@ int main(int argc, char *args[])
 		return 2;
 	}
 
+	// Draw all of the screen the first frame
+	dirty.add(screen->clip_rect);
+
+	// Start the simulation clock
+	step.start();
+
+	// Start pacing frames
+	fps.start();
+
 	while(quit == false)
 	{
-		// Start the frame timer
-		fps.start();
-
 		while(SDL_PollEvent(&event))
 		{
 			// Handle events for the dot
@@ -114,25 +233,37 @@ int main(int argc, char *args[])
 			}
 		}
 
-		myDot.move();
-
-		// Fill the screen white
-		SDL_FillRect( screen, &screen->clip_rect, SDL_MapRGB( screen->format, 0xFF, 0xFF, 0xFF ) );
+		// Run the ticks that have built up since the last frame
+		int ticks = step.advance();
+		for(int i = 0; i < ticks; i++)
+		{
+			myDot.move();
+		}
 
-		// Show the dot on the screen
-		myDot.show();
+		// Move the dot to where it's shown this frame
+		myDot.place(step.get_alpha(), dirty);
 
-		// Update the screen
-		if(SDL_Flip(screen) == -1)
+		// Redraw only the changed areas
+		for(int i = 0; i < dirty.get_count(); i++)
 		{
-			return 3;
+			SDL_Rect area = dirty.get(i);
+
+			// Keep the drawing inside the area
+			SDL_SetClipRect(screen, &area);
+
+			// Fill the area white
+			SDL_FillRect(screen, &area, SDL_MapRGB(screen->format, 0xFF, 0xFF, 0xFF));
+
+			// Show the dot on the screen
+			myDot.show();
 		}
+		SDL_SetClipRect(screen, NULL);
+
+		// Update the changed parts of the screen
+		dirty.update(screen);
 
 		// Cap the frame rate
-		if(fps.get_ticks() < 1000 / FRAMES_PER_SECOND)
-		{
-			SDL_Delay((1000/FRAMES_PER_SECOND) - fps.get_ticks());
-		}
+		fps.wait();
 	}
 	clean_up();
 	return 0;
@@ -200,11 +331,57 @@ void clean_up()
 	SDL_Quit();
 }
 
+FixedStep::FixedStep(int ticksPerSecond)
+{
+	// Initialize the variables
+	tickLength = 1000.0 / ticksPerSecond;
+	lastTicks = 0;
+	accumulator = 0;
+}
+
+void FixedStep::start()
+{
+	// Start counting from nothing built up
+	clock.start();
+	lastTicks = 0;
+	accumulator = 0;
+}
+
+int FixedStep::advance()
+{
+	// Add the time the last frame took
+	double now = clock.get_ticks();
+	accumulator += now - lastTicks;
+	lastTicks = now;
+
+	// Take out as many whole ticks as have built up
+	int ticks = (int)(accumulator / tickLength);
+	accumulator -= ticks * tickLength;
+
+	// If the frame took too long, drop the time rather than falling further behind
+	if(ticks > MAX_TICKS_PER_FRAME)
+	{
+		ticks = MAX_TICKS_PER_FRAME;
+	}
+
+	return ticks;
+}
+
+float FixedStep::get_alpha()
+{
+	// The leftover time as part of a tick
+	return (float)(accumulator / tickLength);
+}
+
 Dot::Dot()
 {
 	// Initialize the offsets
 	x = 0;
 	y = 0;
+	prevX = 0;
+	prevY = 0;
+	showX = 0;
+	showY = 0;
 
 	// Initialize the velocity
 	xVel = 0;
@@ -242,6 +419,10 @@ void Dot::handle_input()
 
 void Dot::move()
 {
+	// Keep where the dot was for drawing between ticks
+	prevX = x;
+	prevY = y;
+
 	// Move the dot left or right
 	x += xVel;
 
@@ -263,17 +444,42 @@ void Dot::move()
 	}
 }
 
+void Dot::place(float alpha, DirtyRects &dirty)
+{
+	// Place the dot part of the way from its last offsets to its current ones
+	int newX = prevX + (int)floor((x - prevX) * alpha + 0.5f);
+	int newY = prevY + (int)floor((y - prevY) * alpha + 0.5f);
+
+	// If the dot moved, where it was and where it is both need redrawing
+	if((newX != showX) || (newY != showY))
+	{
+		SDL_Rect area;
+		area.w = DOT_WIDTH;
+		area.h = DOT_HEIGHT;
+
+		area.x = showX;
+		area.y = showY;
+		dirty.add(area);
+
+		area.x = newX;
+		area.y = newY;
+		dirty.add(area);
+
+		showX = newX;
+		showY = newY;
+	}
+}
+
 void Dot::show()
 {
-	// Show the dot
-	apply_surface(x, y, dot, screen);
+	apply_surface(showX, showY, dot, screen);
 }
 
 Timer::Timer()
 {
 	// Initialize the variables
-	startTicks = 0;
-	pausedTicks = 0;
+	startTime = std::chrono::steady_clock::time_point();
+	pausedTime = std::chrono::nanoseconds::zero();
 	paused = false;
 	started = false;
 }
@@ -287,7 +493,7 @@ void Timer::start()
 	paused = false;
 
 	// Get the current clock time 
-	startTicks =SDL_GetTicks();	
+	startTime = std::chrono::steady_clock::now();
 }
 
 void Timer::stop()
@@ -300,7 +506,7 @@ void Timer::stop()
 
 }
 
-int Timer::get_ticks()
+std::chrono::nanoseconds Timer::get_time()
 {
 	// If the timer is running
 	if(started == true)
@@ -309,17 +515,23 @@ int Timer::get_ticks()
 		if(paused == true)
 		{
 			// Return the number of ticks when the timer was paused
-			return pausedTicks;
+			return pausedTime;
 		}
 		else
 		{
 			// Return the current time minus the start time
-			return SDL_GetTicks() - startTicks;	
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime);
 		}
 
 	}
 	// If the timer isn't running
-	return 0;
+	return std::chrono::nanoseconds::zero();
+}
+
+double Timer::get_ticks()
+{
+	// Convert the time to fractional milliseconds
+	return std::chrono::duration<double, std::milli>(get_time()).count();
 }
 
 void Timer::pause()
@@ -331,7 +543,7 @@ void Timer::pause()
 		paused = true;
 
 		// Calculate the paused ticks
-		pausedTicks = SDL_GetTicks() - startTicks;
+		pausedTime = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime);
 	}
 }
 
@@ -344,10 +556,10 @@ void Timer::unpause()
 		paused = false;
 
 		// Reset the starting ticks
-		startTicks = SDL_GetTicks() - pausedTicks;
+		startTime = std::chrono::steady_clock::now() - pausedTime;
 
 		// Reset the paused ticks
-		pausedTicks = 0;
+		pausedTime = std::chrono::nanoseconds::zero();
 	}
 }
 
@@ -360,3 +572,139 @@ bool Timer::is_paused()
 {
 	return paused;
 }
+
+FramePacer::FramePacer(int framesPerSecond)
+{
+	// Initialize the variables
+	frameLength = 1000.0 / framesPerSecond;
+	deadline = 0;
+	missed = 0;
+}
+
+void FramePacer::start()
+{
+	// Start the clock with the first frame due one frame from now
+	clock.start();
+	deadline = frameLength;
+}
+
+void FramePacer::wait()
+{
+	double now = clock.get_ticks();
+
+	// If the frame ran past its deadline
+	if(now > deadline)
+	{
+		missed++;
+
+		// If it's a whole frame behind, start over from now instead of rushing to catch up
+		if(now - deadline >= frameLength)
+		{
+			deadline = now;
+		}
+	}
+	else
+	{
+		// Sleep through most of the wait, the OS may wake us late
+		if(deadline - now > PACER_SPIN_TIME)
+		{
+			SDL_Delay((Uint32)(deadline - now - PACER_SPIN_TIME));
+		}
+
+		// Spin out the rest against the clock
+		while(clock.get_ticks() < deadline)
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	// The next deadline is one frame after this one, so lateness doesn't add up
+	deadline += frameLength;
+}
+
+int FramePacer::get_missed()
+{
+	return missed;
+}
+
+void DirtyRects::add(SDL_Rect rect)
+{
+	// Clip the area to the screen
+	int left = std::max((int)rect.x, 0);
+	int top = std::max((int)rect.y, 0);
+	int right = std::min(rect.x + rect.w, SCREEN_WIDTH);
+	int bottom = std::min(rect.y + rect.h, SCREEN_HEIGHT);
+
+	// If none of it is on the screen
+	if((right <= left) || (bottom <= top))
+	{
+		return;
+	}
+
+	// Swallow every area it overlaps so no pixel is redrawn twice
+	for(unsigned int i = 0; i < rects.size(); )
+	{
+		SDL_Rect &other = rects[i];
+		if((left < other.x + other.w) && (other.x < right) && (top < other.y + other.h) && (other.y < bottom))
+		{
+			left = std::min(left, (int)other.x);
+			top = std::min(top, (int)other.y);
+			right = std::max(right, other.x + other.w);
+			bottom = std::max(bottom, other.y + other.h);
+
+			// The grown area may now overlap ones already checked
+			rects[i] = rects.back();
+			rects.pop_back();
+			i = 0;
+		}
+		else
+		{
+			i++;
+		}
+	}
+
+	rect.x = left;
+	rect.y = top;
+	rect.w = right - left;
+	rect.h = bottom - top;
+	rects.push_back(rect);
+
+	// Past a point one area covering them all is cheaper than many small ones
+	if(rects.size() > DIRTY_MAX_RECTS)
+	{
+		for(unsigned int i = 0; i < rects.size(); i++)
+		{
+			left = std::min(left, (int)rects[i].x);
+			top = std::min(top, (int)rects[i].y);
+			right = std::max(right, rects[i].x + rects[i].w);
+			bottom = std::max(bottom, rects[i].y + rects[i].h);
+		}
+		rect.x = left;
+		rect.y = top;
+		rect.w = right - left;
+		rect.h = bottom - top;
+		rects.clear();
+		rects.push_back(rect);
+	}
+}
+
+int DirtyRects::get_count()
+{
+	return rects.size();
+}
+
+SDL_Rect DirtyRects::get(int i)
+{
+	return rects[i];
+}
+
+void DirtyRects::update(SDL_Surface *screen)
+{
+	// Push only the changed areas
+	if(rects.empty() == false)
+	{
+		SDL_UpdateRects(screen, rects.size(), &rects[0]);
+	}
+
+	rects.clear();
+}
@@ -6,6 +6,12 @@
 #include "SDL_Image.h"
 #include "SDL_ttf.h"
 #include <string>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <fstream>
+#include <sstream>
+#include <map>
 
 // Constants
 const int SCREEN_WIDTH = 640;
@@ -16,6 +22,12 @@ const int CLIP_MOUSEOUT = 1;
 const int CLIP_MOUSEDOWN = 2;
 const int CLIP_MOUSEUP = 3;
 
+// The most changed areas kept apart before they're merged into one
+const unsigned int DIRTY_MAX_RECTS = 32;
+
+// The layer the button is drawn on
+const int BUTTON_LAYER = 0;
+
 // Surfaces
 SDL_Surface* background = NULL;
 SDL_Surface* screen = NULL;
@@ -37,12 +49,95 @@ class Button
 		// Shows the button on the screen
 		void show();
 
+		// Checks if the sprite region changed since the button was last shown
+		bool changed();
+
+		// Gets the area the button covers
+		SDL_Rect get_box();
+
 	private:
 		// Attributes of the button
 		SDL_Rect box;
 
 		// The part of the button sprite sheet that will be shown
 		SDL_Rect* clip;
+
+		// The part of the button sprite sheet on the screen now
+		SDL_Rect* shownClip;
+};
+
+// Tracks the parts of the screen that changed this frame so only they are redrawn and pushed
+class DirtyRects
+{
+  public:
+		// Marks an area of the screen as changed
+		void add(SDL_Rect rect);
+
+		// Gets the changed areas, none of them overlap
+		int get_count();
+		SDL_Rect get(int i);
+
+		// Pushes the changed areas to the screen and starts the next frame with none
+		void update(SDL_Surface *screen);
+
+  private:
+		// The changed areas
+		std::vector<SDL_Rect> rects;
+};
+
+// Sprites queued for the frame and drawn together, sorted by layer then source surface
+class SpriteBatch
+{
+  public:
+		// Queues the clip of the source to be drawn at the offsets, higher layers are drawn over lower ones
+		void add(SDL_Surface *source, SDL_Rect *clip, int x, int y, int layer);
+
+		// Draws the queued sprites inside the destination's clip rect and empties the batch
+		void flush(SDL_Surface *destination);
+
+  private:
+		// A queued sprite
+		struct Sprite
+		{
+			SDL_Surface *source;
+			SDL_Rect clip;
+			int x, y;
+			int layer;
+		};
+
+		// The sprites queued this frame
+		std::vector<Sprite> sprites;
+
+		// Orders sprites by layer, then by source so blits from one surface run together
+		static bool draw_order(const Sprite &a, const Sprite &b);
+};
+
+// Sprites packed onto atlas pages by atlasPacker, looked up by name
+class Atlas
+{
+  public:
+		// Loads the index and its pages, returns false if any of it couldn't be loaded
+		bool load(std::string indexFile);
+
+		// Frees the pages
+		void clear();
+
+		// Gets the page and clip of the named sprite, returns false if there's no such sprite
+		bool find(std::string name, SDL_Surface *&page, SDL_Rect &clip);
+
+  private:
+		// Where a sprite is
+		struct Entry
+		{
+			unsigned int page;
+			SDL_Rect clip;
+		};
+
+		// The sprites by name
+		std::map<std::string, Entry> entries;
+
+		// The pages
+		std::vector<SDL_Surface *> pages;
 };
 
 // Function Prototypes
@@ -56,6 +151,15 @@ SDL_Surface* load_image(std::string filename);
 // Array of four rectangles, hold the offsets
 SDL_Rect clips[4];
 
+// The surface each clip is on
+SDL_Surface* clipSheets[4];
+
+// The sprite atlas
+Atlas atlas;
+
+// The sprites drawn this frame
+SpriteBatch sprites;
+
 int main(int argc, char* args[])
 {
 	// Quit flag
@@ -72,11 +176,13 @@ int main(int argc, char* args[])
 	{
 		return 1;
 	}
-	
-	set_clips();
 
 	Button myButton(170, 120, 320, 240);
 
+	// The parts of the screen to redraw, all of it to begin with
+	DirtyRects dirty;
+	dirty.add(screen->clip_rect);
+
 	// While the user has not quit
 	while(quit == false)
 	{
@@ -92,17 +198,33 @@ int main(int argc, char* args[])
 				quit = true;
 			}
 		}
-		// Fill the screen white
-		SDL_FillRect(screen, &screen->clip_rect, SDL_MapRGB(screen->format, 0xFF, 0xFF, 0xFF));
-
-		// Show the button
-		myButton.show();
+		// If the button's sprite changed it needs redrawing
+		if(myButton.changed() == true)
+		{
+			dirty.add(myButton.get_box());
+		}
 
-		// Update the screen
-		if(SDL_Flip(screen) == -1)
+		// Redraw only the changed areas
+		for(int i = 0; i < dirty.get_count(); i++)
 		{
-			return 1;
+			SDL_Rect area = dirty.get(i);
+
+			// Keep the drawing inside the area
+			SDL_SetClipRect(screen, &area);
+
+			// Fill the area white
+			SDL_FillRect(screen, &area, SDL_MapRGB(screen->format, 0xFF, 0xFF, 0xFF));
+
+			// Show the button
+			myButton.show();
+
+			// Draw the queued sprites inside the area
+			sprites.flush(screen);
 		}
+		SDL_SetClipRect(screen, NULL);
+
+		// Update the changed parts of the screen
+		dirty.update(screen);
 		
 	}
 	// Free surfaces
@@ -205,13 +327,50 @@ bool load_files()
 {
 	// Load the background image
 	background = load_image("background.png");
+
+	// If not loaded
+	if(background == NULL)
+	{
+		return false;
+	}
+
+	// Use the atlas if the button was packed into one, as button0 to button3
+	if(atlas.load("atlas.txt") == true)
+	{
+		bool found = true;
+		for(int i = 0; i < 4; i++)
+		{
+			std::stringstream name;
+			name << "button" << i;
+			if(atlas.find(name.str(), clipSheets[i], clips[i]) == false)
+			{
+				found = false;
+			}
+		}
+
+		if(found == true)
+		{
+			return true;
+		}
+		atlas.clear();
+	}
+
+	// Otherwise load the sheet
 	buttonSheet = load_image("button.png");
 
 	// If not loaded
-	if(background == NULL || buttonSheet == NULL)
+	if(buttonSheet == NULL)
 	{
 		return false;
 	}
+
+	set_clips();
+
+	// Every clip is on the one sheet
+	for(int i = 0; i < 4; i++)
+	{
+		clipSheets[i] = buttonSheet;
+	}
 	return true;
 }
 
@@ -220,6 +379,7 @@ void clean_up()
 	// Free surfaces
 	SDL_FreeSurface(background);
 	SDL_FreeSurface(buttonSheet);
+	atlas.clear();
 	// Quit SDL_ttf
 	TTF_Quit();
 	// Quit
@@ -236,6 +396,9 @@ Button::Button(int x, int y, int w, int h)
 
 	// Set the default sprite
 	clip = &clips[CLIP_MOUSEOUT];
+
+	// Nothing is shown yet
+	shownClip = NULL;
 }
 
 void Button::handle_events()
@@ -306,5 +469,281 @@ void Button::handle_events()
 void Button::show()
 {
 	// Show the button
-	apply_surface(box.x, box.y, buttonSheet, screen, clip);
+	sprites.add(clipSheets[clip - clips], clip, box.x, box.y, BUTTON_LAYER);
+	shownClip = clip;
+}
+
+bool Button::changed()
+{
+	return clip != shownClip;
+}
+
+SDL_Rect Button::get_box()
+{
+	return box;
+}
+
+void DirtyRects::add(SDL_Rect rect)
+{
+	// Clip the area to the screen
+	int left = std::max((int)rect.x, 0);
+	int top = std::max((int)rect.y, 0);
+	int right = std::min(rect.x + rect.w, SCREEN_WIDTH);
+	int bottom = std::min(rect.y + rect.h, SCREEN_HEIGHT);
+
+	// If none of it is on the screen
+	if((right <= left) || (bottom <= top))
+	{
+		return;
+	}
+
+	// Swallow every area it overlaps so no pixel is redrawn twice
+	for(unsigned int i = 0; i < rects.size(); )
+	{
+		SDL_Rect &other = rects[i];
+		if((left < other.x + other.w) && (other.x < right) && (top < other.y + other.h) && (other.y < bottom))
+		{
+			left = std::min(left, (int)other.x);
+			top = std::min(top, (int)other.y);
+			right = std::max(right, other.x + other.w);
+			bottom = std::max(bottom, other.y + other.h);
+
+			// The grown area may now overlap ones already checked
+			rects[i] = rects.back();
+			rects.pop_back();
+			i = 0;
+		}
+		else
+		{
+			i++;
+		}
+	}
+
+	rect.x = left;
+	rect.y = top;
+	rect.w = right - left;
+	rect.h = bottom - top;
+	rects.push_back(rect);
+
+	// Past a point one area covering them all is cheaper than many small ones
+	if(rects.size() > DIRTY_MAX_RECTS)
+	{
+		for(unsigned int i = 0; i < rects.size(); i++)
+		{
+			left = std::min(left, (int)rects[i].x);
+			top = std::min(top, (int)rects[i].y);
+			right = std::max(right, rects[i].x + rects[i].w);
+			bottom = std::max(bottom, rects[i].y + rects[i].h);
+		}
+		rect.x = left;
+		rect.y = top;
+		rect.w = right - left;
+		rect.h = bottom - top;
+		rects.clear();
+		rects.push_back(rect);
+	}
+}
+
+int DirtyRects::get_count()
+{
+	return rects.size();
+}
+
+SDL_Rect DirtyRects::get(int i)
+{
+	return rects[i];
+}
+
+void DirtyRects::update(SDL_Surface *screen)
+{
+	// Push only the changed areas
+	if(rects.empty() == false)
+	{
+		SDL_UpdateRects(screen, rects.size(), &rects[0]);
+	}
+
+	rects.clear();
+}
+
+void SpriteBatch::add(SDL_Surface *source, SDL_Rect *clip, int x, int y, int layer)
+{
+	Sprite sprite;
+	sprite.source = source;
+	sprite.x = x;
+	sprite.y = y;
+	sprite.layer = layer;
+
+	// No clip means the whole surface
+	int left = 0;
+	int top = 0;
+	int right = source->w;
+	int bottom = source->h;
+
+	// Keep the clip inside the source so flush can skip SDL's checks
+	if(clip != NULL)
+	{
+		left = std::max((int)clip->x, 0);
+		top = std::max((int)clip->y, 0);
+		right = std::min(clip->x + clip->w, source->w);
+		bottom = std::min(clip->y + clip->h, source->h);
+
+		sprite.x += left - clip->x;
+		sprite.y += top - clip->y;
+	}
+
+	// If nothing of the clip is left
+	if((right <= left) || (bottom <= top))
+	{
+		return;
+	}
+
+	sprite.clip.x = left;
+	sprite.clip.y = top;
+	sprite.clip.w = right - left;
+	sprite.clip.h = bottom - top;
+
+	sprites.push_back(sprite);
+}
+
+bool SpriteBatch::draw_order(const Sprite &a, const Sprite &b)
+{
+	if(a.layer != b.layer)
+	{
+		return a.layer < b.layer;
+	}
+	// Then by source, std::less gives pointers to separate surfaces a set order where < doesn't
+	return std::less<SDL_Surface *>()(a.source, b.source);
+}
+
+void SpriteBatch::flush(SDL_Surface *destination)
+{
+	// Sort the sprites, keeping the order they were added in within a layer and source
+	std::stable_sort(sprites.begin(), sprites.end(), draw_order);
+
+	// The area that can be drawn to
+	SDL_Rect bounds = destination->clip_rect;
+
+	for(unsigned int i = 0; i < sprites.size(); i++)
+	{
+		Sprite &sprite = sprites[i];
+
+		// Clip the sprite to the drawable area
+		int left = std::max(sprite.x, (int)bounds.x);
+		int top = std::max(sprite.y, (int)bounds.y);
+		int right = std::min(sprite.x + sprite.clip.w, bounds.x + bounds.w);
+		int bottom = std::min(sprite.y + sprite.clip.h, bounds.y + bounds.h);
+
+		// If the sprite is off the drawable area, cull it
+		if((right <= left) || (bottom <= top))
+		{
+			continue;
+		}
+
+		// The part of the source that shows
+		SDL_Rect source;
+		source.x = sprite.clip.x + left - sprite.x;
+		source.y = sprite.clip.y + top - sprite.y;
+		source.w = right - left;
+		source.h = bottom - top;
+
+		// Where it shows
+		SDL_Rect offset;
+		offset.x = left;
+		offset.y = top;
+		offset.w = source.w;
+		offset.h = source.h;
+
+		// Both rects are already clipped so the checks in SDL_BlitSurface can be skipped
+		SDL_LowerBlit(sprite.source, &source, destination, &offset);
+	}
+
+	sprites.clear();
+}
+
+bool Atlas::load(std::string indexFile)
+{
+	std::ifstream index(indexFile.c_str());
+	if(index.fail() == true)
+	{
+		return false;
+	}
+
+	// The pages are named relative to the index
+	std::string folder = "";
+	size_t slash = indexFile.find_last_of("/\\");
+	if(slash != std::string::npos)
+	{
+		folder = indexFile.substr(0, slash + 1);
+	}
+
+	std::string word;
+	while(index >> word)
+	{
+		// A page to load
+		if(word == "page")
+		{
+			std::string file;
+			index >> file;
+
+			SDL_Surface *page = load_image(folder + file);
+			if(page == NULL)
+			{
+				clear();
+				return false;
+			}
+			pages.push_back(page);
+		}
+		// A sprite's name, page and clip
+		else
+		{
+			Entry entry;
+			int x, y, w, h;
+			index >> entry.page >> x >> y >> w >> h;
+
+			if((index.fail() == true) || (entry.page >= pages.size()))
+			{
+				clear();
+				return false;
+			}
+
+			// The clip has to be on its page, it's used as is
+			SDL_Surface *page = pages[entry.page];
+			if((x < 0) || (y < 0) || (w <= 0) || (h <= 0) || ((Sint64)x + w > page->w) || ((Sint64)y + h > page->h))
+			{
+				clear();
+				return false;
+			}
+
+			entry.clip.x = x;
+			entry.clip.y = y;
+			entry.clip.w = w;
+			entry.clip.h = h;
+			entries[word] = entry;
+		}
+	}
+
+	return pages.empty() == false;
+}
+
+void Atlas::clear()
+{
+	for(unsigned int i = 0; i < pages.size(); i++)
+	{
+		SDL_FreeSurface(pages[i]);
+	}
+	pages.clear();
+	entries.clear();
+}
+
+bool Atlas::find(std::string name, SDL_Surface *&page, SDL_Rect &clip)
+{
+	std::map<std::string, Entry>::iterator found = entries.find(name);
+	if(found == entries.end())
+	{
+		return false;
+	}
+
+	page = pages[found->second.page];
+	clip = found->second.clip;
+	return true;
 }
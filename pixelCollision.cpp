@@ -1,7 +1,11 @@
 // Headers
 #include <iostream>
 #include <string>
+#include <chrono>
+#include <thread>
 #include <vector>
+#include <algorithm>
+#include <functional>
 #include "SDL.h"
 #include "SDL_image.h"
 
@@ -13,15 +17,24 @@ const int SCREEN_BPP = 32;
 const int DOT_HEIGHT = 20;
 const int DOT_WIDTH = 20;
 
+// The layer the dots are drawn on
+const int DOT_LAYER = 0;
+
 const int FRAMES_PER_SECOND = 20;
 
+// How long before a deadline the frame pacer stops sleeping and spins, in milliseconds
+const double PACER_SPIN_TIME = 2.0;
+
+// The broad phase grid, cells should be larger than a dot
+const int GRID_CELL_SIZE = 64;
+const int GRID_BUCKETS = 1024;
+
 // Prototypes
 bool init();
 SDL_Surface *load_image(std::string filename);
 bool load_files();
 void apply_surface(int x, int y, SDL_Surface *source, SDL_Surface *destination, SDL_Rect *clip = NULL);
 void clean_up();
-bool check_collision(std::vector<SDL_Rect> &A, std::vector<SDL_Rect> &B);
 
 // Surfaces
 SDL_Surface *screen = NULL;
@@ -47,8 +60,11 @@ class Timer
 	void pause();
 	void unpause();
 
-	// Get the timer's time
-	int get_ticks();
+	// Get the timer's time in milliseconds
+	double get_ticks();
+
+	// Get the timer's time at full resolution
+	std::chrono::nanoseconds get_time();
 
 	// Checks the status of the timer
 	bool is_started();
@@ -56,46 +72,164 @@ class Timer
 
 	private:
 	// The time when the timer startered
-	int startTicks;
+	std::chrono::steady_clock::time_point startTime;
 
 	// The ticks stored when the timer was paused
-	int pausedTicks;
+	std::chrono::nanoseconds pausedTime;
 
 	// The timer status
 	bool paused;
 	bool started;
 };
 
+// Holds frames to a fixed rate against a running deadline
+class FramePacer
+{
+	public:
+		// Sets the frame rate to pace to
+		FramePacer(int framesPerSecond);
+
+		// Sets the first deadline one frame from now
+		void start();
+
+		// Waits for the current deadline and moves it on by one frame
+		void wait();
+
+		// Gets the number of deadlines that had already passed when waited on
+		int get_missed();
+
+	private:
+		// The time since pacing started
+		Timer clock;
+
+		// The length of a frame in milliseconds
+		double frameLength;
+
+		// When the current frame should end
+		double deadline;
+
+		// The number of missed deadlines
+		int missed;
+};
+
+// Per pixel collision mask, one bit per opaque pixel packed into 64 bit row words
+class CollisionMask
+{
+public:
+	CollisionMask();
+	// Builds the mask from the pixels that aren't the surface's color key
+	void build(SDL_Surface *surface);
+	// Checks the masks for overlapping pixels with B offset from this mask's top left
+	bool overlaps(CollisionMask &B, int xOffset, int yOffset);
+private:
+	// The dimensions of the mask
+	int w, h;
+	// The number of words in each row
+	int rowWords;
+	// The mask bits, the lowest bit of a word is its leftmost pixel
+	std::vector<Uint64> bits;
+	// Gets the 64 bits of a row starting at any column, outside the mask is clear
+	Uint64 row_bits(int row, int column);
+};
+
+// Uniform grid broad phase, entities are bucketed by their bounding box
+class SpatialHash
+{
+public:
+	SpatialHash(int cellSize, int bucketCount);
+	// Adds the entity to every cell its bounding box covers
+	void insert(int id, SDL_Rect &bounds);
+	// Takes the entity out of the cells it was inserted with
+	void remove(int id, SDL_Rect &bounds);
+	// Gets the entities sharing a cell with the bounding box, each only once
+	void query(SDL_Rect &bounds, std::vector<int> &found);
+private:
+	// The size of a square cell
+	int cellSize;
+	// The entity ids in each bucket
+	std::vector< std::vector<int> > buckets;
+	// The last query each entity was reported by
+	std::vector<int> marks;
+	int queryMark;
+	// Gets the bucket a cell hashes to
+	std::vector<int> &bucket(int cellX, int cellY);
+	// Gets the cell an offset falls in
+	int cell(int offset);
+};
+
 class Dot
 {
 public:
-	Dot(int x, int y, int z);
+	Dot(int x, int y, int z, int id);
 	void handle_input();
 	// Moves the dot
-	void move(std::vector<SDL_Rect> &rects);
+	void move(std::vector<Dot> &dots, SpatialHash &grid);
 	// Shows the dot on the screen
 	void show();
-	// Gets the collision boxes
-	std::vector<SDL_Rect> &get_rects();
+	// Gets the box around the whole dot
+	SDL_Rect get_bounds();
 private:
 	// The offsets of the dot
 	int x, y;
+	// The dot's entry in the broad phase grid
+	int id;
 	// Choose controls. 0 = w, a, s, d, 1 = up, left, down, right 
 	int keySet;
-	// The collision boxes of the dot
-	std::vector<SDL_Rect> box;
 	// The velocity of the dot
 	int xVel, yVel;
-	// Moves the collision boxes relative to the dot's offset
-	void shift_boxes();
+	// Checks the mask against the dots the grid puts near this one
+	bool collides(std::vector<Dot> &dots, SpatialHash &grid);
+};
+
+// Sprites queued for the frame and drawn together, sorted by layer then source surface
+class SpriteBatch
+{
+public:
+	// Queues the clip of the source to be drawn at the offsets, higher layers are drawn over lower ones
+	void add(SDL_Surface *source, SDL_Rect *clip, int x, int y, int layer);
+
+	// Draws the queued sprites inside the destination's clip rect and empties the batch
+	void flush(SDL_Surface *destination);
+
+private:
+	// A queued sprite
+	struct Sprite
+	{
+		SDL_Surface *source;
+		SDL_Rect clip;
+		int x, y;
+		int layer;
+	};
+
+	// The sprites queued this frame
+	std::vector<Sprite> sprites;
+
+	// Orders sprites by layer, then by source so blits from one surface run together
+	static bool draw_order(const Sprite &a, const Sprite &b);
 };
 
+// The dot's collision mask
+CollisionMask dotMask;
+
+// The sprites drawn this frame
+SpriteBatch sprites;
+
 int main()
 {
-	Timer fps;
+	FramePacer fps(FRAMES_PER_SECOND);
 	
-	Dot myDot(0, 0, 1);
-	Dot otherDot(20, 20, 2);
+	// The dots, indexed by their grid id
+	std::vector<Dot> dots;
+	dots.push_back(Dot(0, 0, 1, 0));
+	dots.push_back(Dot(20, 20, 2, 1));
+
+	// Bucket the dots at their starting offsets
+	SpatialHash grid(GRID_CELL_SIZE, GRID_BUCKETS);
+	for(int i = 0; i < (int)dots.size(); i++)
+	{
+		SDL_Rect bounds = dots[i].get_bounds();
+		grid.insert(i, bounds);
+	}
 
 	bool quit = false;
 
@@ -109,24 +243,29 @@ int main()
 		return 2;
 	}
 
+	// Start pacing frames
+	fps.start();
+
 	while(quit == false)
 	{
-		// Start the frame timer
-		fps.start();
-
 		while(SDL_PollEvent(&event))
 		{
-			// Handle events for the dot
-			myDot.handle_input();
-			otherDot.handle_input();
+			// Handle events for the dots
+			for(int i = 0; i < (int)dots.size(); i++)
+			{
+				dots[i].handle_input();
+			}
 			if(event.type == SDL_QUIT)
 			{
 				quit = true;
 			}
 		}
 
-		myDot.move(otherDot.get_rects());
-		otherDot.move(myDot.get_rects());
+		// Move the dots
+		for(int i = 0; i < (int)dots.size(); i++)
+		{
+			dots[i].move(dots, grid);
+		}
 
 		// Fill the screen white
 		SDL_FillRect( screen, &screen->clip_rect, SDL_MapRGB( screen->format, 0xFF, 0xFF, 0xFF ) );
@@ -134,9 +273,14 @@ int main()
 		// Show the wall
 		SDL_FillRect(screen, &wall, SDL_MapRGB(screen->format, 0x77, 0x77, 0x77));
 
-		// Show the square on the screen
-		myDot.show();
-		otherDot.show();
+		// Show the dots on the screen
+		for(int i = 0; i < (int)dots.size(); i++)
+		{
+			dots[i].show();
+		}
+
+		// Draw the queued sprites
+		sprites.flush(screen);
 
 		// Update the screen
 		if(SDL_Flip(screen) == -1)
@@ -145,10 +289,7 @@ int main()
 		}
 
 		// Cap the frame rate
-		if(fps.get_ticks() < 1000 / FRAMES_PER_SECOND)
-		{
-			SDL_Delay((1000/FRAMES_PER_SECOND) - fps.get_ticks());
-		}
+		fps.wait();
 	}
 	clean_up();
 	return 0;
@@ -198,6 +339,10 @@ bool load_files()
 	{
 		return false;
 	}
+
+	// Build the collision mask from the dot's color key
+	dotMask.build(dot);
+
 	return true;
 }
 
@@ -217,47 +362,11 @@ void clean_up()
 }
 
 
-bool check_collision(std::vector<SDL_Rect> &A, std::vector<SDL_Rect> &B )
-{
-	// The side of the rectangles
-	int leftA, leftB;
-	int rightA, rightB;
-	int topA, topB;
-	int bottomA, bottomB;
-	int Abox, Bbox;
-
-	// Go through the A boxes
-	for(Abox = 0; Abox < A.size(); Abox++)
-	{
-		leftA = A[Abox].x;
-		rightA = A[Abox].x + A[Abox].w;
-		topA = A[Abox].y;
-		bottomA = A[Abox].y + A[Abox].h;
-
-		// Go through the B boxes
-		for(Bbox = 0; Bbox < B.size(); Bbox++)
-		{
-			leftB = B[Bbox].x;
-			rightB = B[Bbox].x + B[Bbox].w;
-			topB = B[Bbox].y;
-			bottomB = B[Bbox].y + B[Bbox].h;
-
-			if(((bottomA <= topB) || (topA >= bottomB) || (rightA <= leftB) || (leftA >= rightB)) == false)
-			{
-				// A collision is detected!
-				return true;
-			}
-		}
-	}
-	// If neither set of collision boxes touched
-	return false;
-}
-
 Timer::Timer()
 {
 	// Initialize the variables
-	startTicks = 0;
-	pausedTicks = 0;
+	startTime = std::chrono::steady_clock::time_point();
+	pausedTime = std::chrono::nanoseconds::zero();
 	paused = false;
 	started = false;
 }
@@ -271,7 +380,7 @@ void Timer::start()
 	paused = false;
 
 	// Get the current clock time 
-	startTicks =SDL_GetTicks();	
+	startTime = std::chrono::steady_clock::now();
 }
 
 void Timer::stop()
@@ -284,7 +393,7 @@ void Timer::stop()
 
 }
 
-int Timer::get_ticks()
+std::chrono::nanoseconds Timer::get_time()
 {
 	// If the timer is running
 	if(started == true)
@@ -293,17 +402,23 @@ int Timer::get_ticks()
 		if(paused == true)
 		{
 			// Return the number of ticks when the timer was paused
-			return pausedTicks;
+			return pausedTime;
 		}
 		else
 		{
 			// Return the current time minus the start time
-			return SDL_GetTicks() - startTicks;	
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime);
 		}
 
 	}
 	// If the timer isn't running
-	return 0;
+	return std::chrono::nanoseconds::zero();
+}
+
+double Timer::get_ticks()
+{
+	// Convert the time to fractional milliseconds
+	return std::chrono::duration<double, std::milli>(get_time()).count();
 }
 
 void Timer::pause()
@@ -315,7 +430,7 @@ void Timer::pause()
 		paused = true;
 
 		// Calculate the paused ticks
-		pausedTicks = SDL_GetTicks() - startTicks;
+		pausedTime = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime);
 	}
 }
 
@@ -328,10 +443,10 @@ void Timer::unpause()
 		paused = false;
 
 		// Reset the starting ticks
-		startTicks = SDL_GetTicks() - pausedTicks;
+		startTime = std::chrono::steady_clock::now() - pausedTime;
 
 		// Reset the paused ticks
-		pausedTicks = 0;
+		pausedTime = std::chrono::nanoseconds::zero();
 	}
 }
 
@@ -345,80 +460,241 @@ bool Timer::is_paused()
 	return paused;
 }
 
-Dot::Dot(int x, int y, int z)
+CollisionMask::CollisionMask()
 {
-	// Initialize the offsets
-	this->x = x;
-	this->y = y;
+	// The mask is empty until it's built
+	w = 0;
+	h = 0;
+	rowWords = 0;
+}
 
-	// Initialize the velocity
-	xVel = 0;
-	yVel = 0;
+void CollisionMask::build(SDL_Surface *surface)
+{
+	w = surface->w;
+	h = surface->h;
 
-	// Create the needed SDL_Rects
-	box.resize(11);
+	// Enough words to hold every pixel of a row
+	rowWords = (w + 63) / 64;
+	bits.assign(rowWords * h, 0);
 
-	// Initialize the collision boxes' width and height
-	box[0].w = 6;
-	box[0].h = 1;
+	// Whether any pixels are see through
+	bool keyed = (surface->flags & SDL_SRCCOLORKEY) != 0;
 
-	box[1].w = 10;
-	box[1].h = 1;
+	// Lock the surface to read its pixels
+	if(SDL_MUSTLOCK(surface))
+	{
+		SDL_LockSurface(surface);
+	}
 
-	box[2].w = 14;
-	box[2].h = 1;
+	int bpp = surface->format->BytesPerPixel;
 
-	box[3].w = 16;
-	box[3].h = 2;
+	// Go through the pixels
+	for(int row = 0; row < h; row++)
+	{
+		Uint8 *p = (Uint8 *)surface->pixels + row * surface->pitch;
 
-	box[4].w = 18;
-	box[4].h = 2;
+		for(int column = 0; column < w; column++, p += bpp)
+		{
+			// Read the pixel at its depth
+			Uint32 pixel;
+			switch(bpp)
+			{
+				case 1: pixel = *p; break;
+				case 2: pixel = *(Uint16 *)p; break;
+				case 3:
+					if(SDL_BYTEORDER == SDL_BIG_ENDIAN)
+					{
+						pixel = (p[0] << 16) | (p[1] << 8) | p[2];
+					}
+					else
+					{
+						pixel = p[0] | (p[1] << 8) | (p[2] << 16);
+					}
+					break;
+				default: pixel = *(Uint32 *)p; break;
+			}
 
-	box[5].w = 20;
-	box[5].h = 6;
+			// Only pixels that get drawn can collide
+			if((keyed == false) || (pixel != surface->format->colorkey))
+			{
+				bits[row * rowWords + column / 64] |= (Uint64)1 << (column % 64);
+			}
+		}
+	}
 
-	box[6].w = 18;
-	box[6].w = 2;
+	if(SDL_MUSTLOCK(surface))
+	{
+		SDL_UnlockSurface(surface);
+	}
+}
 
-	box[7].w = 16;
-	box[7].h = 2;
+Uint64 CollisionMask::row_bits(int row, int column)
+{
+	// If the bits are entirely outside the row
+	if((column >= w) || (column <= -64))
+	{
+		return 0;
+	}
 
-	box[8].w = 14;
-	box[8].h = 1;
+	Uint64 *words = &bits[row * rowWords];
 
-	box[9].w = 10;
-	box[9].h = 1;
+	// If the bits start left of the mask only the first word shows
+	if(column < 0)
+	{
+		return words[0] << -column;
+	}
 
-	box[10].w = 6;
-	box[10].h = 1;
+	// Take the end of the word the column is in
+	int word = column / 64;
+	int shift = column % 64;
+	Uint64 result = words[word] >> shift;
 
-	// Move the collision boxes to their proper spot
-	shift_boxes();
+	// And the start of the next one
+	if((shift != 0) && (word + 1 < rowWords))
+	{
+		result |= words[word + 1] << (64 - shift);
+	}
 
-	// Set the movement keys
-	keySet = z;
+	return result;
+}
+
+bool CollisionMask::overlaps(CollisionMask &B, int xOffset, int yOffset)
+{
+	// The area where the masks overlap, in this mask's coordinates
+	int top = std::max(0, yOffset);
+	int bottom = std::min(h, yOffset + B.h);
+	int left = std::max(0, xOffset);
+	int right = std::min(w, xOffset + B.w);
+
+	// Go through the overlapping rows 64 pixels at a time
+	for(int row = top; row < bottom; row++)
+	{
+		for(int column = left; column < right; column += 64)
+		{
+			// If both masks have a pixel in the same spot
+			if((row_bits(row, column) & B.row_bits(row - yOffset, column - xOffset)) != 0)
+			{
+				return true;
+			}
+		}
+	}
+
+	// If no pixels touched
+	return false;
+}
+
+SpatialHash::SpatialHash(int cellSize, int bucketCount)
+{
+	this->cellSize = cellSize;
+
+	// Create the buckets
+	buckets.resize(bucketCount);
+
+	// No query has been run yet
+	queryMark = 0;
+}
+
+int SpatialHash::cell(int offset)
+{
+	// Round down so negative offsets don't share cell 0
+	if(offset < 0)
+	{
+		return (offset - cellSize + 1) / cellSize;
+	}
+	return offset / cellSize;
 }
 
-void Dot::shift_boxes()
+std::vector<int> &SpatialHash::bucket(int cellX, int cellY)
 {
-	// The row offset
-	int r = 0;
-	int set;
+	// Mix the cell coordinates so neighbouring cells spread over the buckets
+	unsigned int hash = ((unsigned int)cellX * 73856093u) ^ ((unsigned int)cellY * 19349663u);
+	return buckets[hash % buckets.size()];
+}
 
-	// Go through the dot's collision boxes
-	for(set = 0; set < box.size(); set++)
+void SpatialHash::insert(int id, SDL_Rect &bounds)
+{
+	// Go through the cells the box covers
+	for(int cellY = cell(bounds.y); cellY <= cell(bounds.y + bounds.h - 1); cellY++)
+	{
+		for(int cellX = cell(bounds.x); cellX <= cell(bounds.x + bounds.w - 1); cellX++)
+		{
+			bucket(cellX, cellY).push_back(id);
+		}
+	}
+
+	// Make room to mark the entity during queries
+	if(id >= (int)marks.size())
+	{
+		marks.resize(id + 1, 0);
+	}
+}
+
+void SpatialHash::remove(int id, SDL_Rect &bounds)
+{
+	// Go through the cells the box covers
+	for(int cellY = cell(bounds.y); cellY <= cell(bounds.y + bounds.h - 1); cellY++)
 	{
-		// Center the collision box
-		box[set].x = x + (DOT_WIDTH - box[set].w)/2;
+		for(int cellX = cell(bounds.x); cellX <= cell(bounds.x + bounds.w - 1); cellX++)
+		{
+			std::vector<int> &entries = bucket(cellX, cellY);
+
+			// Swap one copy of the id with the last entry and drop it
+			for(int i = 0; i < (int)entries.size(); i++)
+			{
+				if(entries[i] == id)
+				{
+					entries[i] = entries.back();
+					entries.pop_back();
+					break;
+				}
+			}
+		}
+	}
+}
 
-		// Set the collision box at its row offset
-		box[set].y = y + r;
+void SpatialHash::query(SDL_Rect &bounds, std::vector<int> &found)
+{
+	found.clear();
 
-		// Move the row offset down the hieght of the collision box
-		r += box[set].h;
+	// Start a new query so entities in several cells are only reported once
+	queryMark++;
+
+	// Go through the cells the box covers
+	for(int cellY = cell(bounds.y); cellY <= cell(bounds.y + bounds.h - 1); cellY++)
+	{
+		for(int cellX = cell(bounds.x); cellX <= cell(bounds.x + bounds.w - 1); cellX++)
+		{
+			std::vector<int> &entries = bucket(cellX, cellY);
+
+			for(int i = 0; i < (int)entries.size(); i++)
+			{
+				if(marks[entries[i]] != queryMark)
+				{
+					marks[entries[i]] = queryMark;
+					found.push_back(entries[i]);
+				}
+			}
+		}
 	}
 }
 
+Dot::Dot(int x, int y, int z, int id)
+{
+	// Initialize the offsets
+	this->x = x;
+	this->y = y;
+
+	// Initialize the grid entry
+	this->id = id;
+
+	// Initialize the velocity
+	xVel = 0;
+	yVel = 0;
+
+	// Set the movement keys
+	keySet = z;
+}
+
 void Dot::handle_input()
 {
 	if(keySet == 1)
@@ -479,45 +755,225 @@ void Dot::handle_input()
 	}
 }
 
-void Dot::move(std::vector<SDL_Rect> &rects)
+bool Dot::collides(std::vector<Dot> &dots, SpatialHash &grid)
+{
+	// The dots that share a cell with this one
+	static std::vector<int> nearby;
+
+	// Only dots in the same cells can touch
+	SDL_Rect bounds = get_bounds();
+	grid.query(bounds, nearby);
+
+	// Check the masks of the nearby dots
+	for(int i = 0; i < (int)nearby.size(); i++)
+	{
+		if(nearby[i] != id)
+		{
+			SDL_Rect other = dots[nearby[i]].get_bounds();
+			if(dotMask.overlaps(dotMask, other.x - x, other.y - y))
+			{
+				return true;
+			}
+		}
+	}
+
+	// If none of the nearby dots touched
+	return false;
+}
+
+void Dot::move(std::vector<Dot> &dots, SpatialHash &grid)
 {
+	// Take the dot out of the grid while it moves
+	SDL_Rect bounds = get_bounds();
+	grid.remove(id, bounds);
+
 	// Move the dot left or right
 	x += xVel;
 
-	// Move the collision boxes
-	shift_boxes();
-
-	// If the dot went too far to the left or right or has collided with the other dot
-	if((x < 0) || (x + DOT_WIDTH > SCREEN_WIDTH) || (check_collision(box, rects)))
+	// If the dot went too far to the left or right or has collided with another dot
+	if((x < 0) || (x + DOT_WIDTH > SCREEN_WIDTH) || (collides(dots, grid)))
 	{
 		// Move back
 		x -= xVel;
-		shift_boxes();
 	}
 
 	// Move the dot up or down
 	y += yVel;
 
-	// Move the collision boxes
-	shift_boxes();
-
-	// If the dot went too far up or down or has collided with the other dot
-	if((y < 0) || (y + DOT_HEIGHT > SCREEN_HEIGHT) || (check_collision(box, rects)))
+	// If the dot went too far up or down or has collided with another dot
+	if((y < 0) || (y + DOT_HEIGHT > SCREEN_HEIGHT) || (collides(dots, grid)))
 	{
 		// Move back
 		y -= yVel;
-		shift_boxes();
 	}
+
+	// Put the dot back in the grid at its new offsets
+	bounds = get_bounds();
+	grid.insert(id, bounds);
 }
 
 void Dot::show()
 {
 	// Show the dot
-	apply_surface(x, y, dot, screen);
+	sprites.add(dot, NULL, x, y, DOT_LAYER);
+}
+
+SDL_Rect Dot::get_bounds()
+{
+	// The box the dot's image covers
+	SDL_Rect bounds;
+	bounds.x = x;
+	bounds.y = y;
+	bounds.w = DOT_WIDTH;
+	bounds.h = DOT_HEIGHT;
+	return bounds;
+}
+
+FramePacer::FramePacer(int framesPerSecond)
+{
+	// Initialize the variables
+	frameLength = 1000.0 / framesPerSecond;
+	deadline = 0;
+	missed = 0;
+}
+
+void FramePacer::start()
+{
+	// Start the clock with the first frame due one frame from now
+	clock.start();
+	deadline = frameLength;
+}
+
+void FramePacer::wait()
+{
+	double now = clock.get_ticks();
+
+	// If the frame ran past its deadline
+	if(now > deadline)
+	{
+		missed++;
+
+		// If it's a whole frame behind, start over from now instead of rushing to catch up
+		if(now - deadline >= frameLength)
+		{
+			deadline = now;
+		}
+	}
+	else
+	{
+		// Sleep through most of the wait, the OS may wake us late
+		if(deadline - now > PACER_SPIN_TIME)
+		{
+			SDL_Delay((Uint32)(deadline - now - PACER_SPIN_TIME));
+		}
+
+		// Spin out the rest against the clock
+		while(clock.get_ticks() < deadline)
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	// The next deadline is one frame after this one, so lateness doesn't add up
+	deadline += frameLength;
 }
 
-std::vector<SDL_Rect> &Dot::get_rects()
+int FramePacer::get_missed()
 {
-	// Retrieve the collision boxes
-	return box;
+	return missed;
+}
+
+void SpriteBatch::add(SDL_Surface *source, SDL_Rect *clip, int x, int y, int layer)
+{
+	Sprite sprite;
+	sprite.source = source;
+	sprite.x = x;
+	sprite.y = y;
+	sprite.layer = layer;
+
+	// No clip means the whole surface
+	int left = 0;
+	int top = 0;
+	int right = source->w;
+	int bottom = source->h;
+
+	// Keep the clip inside the source so flush can skip SDL's checks
+	if(clip != NULL)
+	{
+		left = std::max((int)clip->x, 0);
+		top = std::max((int)clip->y, 0);
+		right = std::min(clip->x + clip->w, source->w);
+		bottom = std::min(clip->y + clip->h, source->h);
+
+		sprite.x += left - clip->x;
+		sprite.y += top - clip->y;
+	}
+
+	// If nothing of the clip is left
+	if((right <= left) || (bottom <= top))
+	{
+		return;
+	}
+
+	sprite.clip.x = left;
+	sprite.clip.y = top;
+	sprite.clip.w = right - left;
+	sprite.clip.h = bottom - top;
+
+	sprites.push_back(sprite);
+}
+
+bool SpriteBatch::draw_order(const Sprite &a, const Sprite &b)
+{
+	if(a.layer != b.layer)
+	{
+		return a.layer < b.layer;
+	}
+	// Then by source, std::less gives pointers to separate surfaces a set order where < doesn't
+	return std::less<SDL_Surface *>()(a.source, b.source);
+}
+
+void SpriteBatch::flush(SDL_Surface *destination)
+{
+	// Sort the sprites, keeping the order they were added in within a layer and source
+	std::stable_sort(sprites.begin(), sprites.end(), draw_order);
+
+	// The area that can be drawn to
+	SDL_Rect bounds = destination->clip_rect;
+
+	for(unsigned int i = 0; i < sprites.size(); i++)
+	{
+		Sprite &sprite = sprites[i];
+
+		// Clip the sprite to the drawable area
+		int left = std::max(sprite.x, (int)bounds.x);
+		int top = std::max(sprite.y, (int)bounds.y);
+		int right = std::min(sprite.x + sprite.clip.w, bounds.x + bounds.w);
+		int bottom = std::min(sprite.y + sprite.clip.h, bounds.y + bounds.h);
+
+		// If the sprite is off the drawable area, cull it
+		if((right <= left) || (bottom <= top))
+		{
+			continue;
+		}
+
+		// The part of the source that shows
+		SDL_Rect source;
+		source.x = sprite.clip.x + left - sprite.x;
+		source.y = sprite.clip.y + top - sprite.y;
+		source.w = right - left;
+		source.h = bottom - top;
+
+		// Where it shows
+		SDL_Rect offset;
+		offset.x = left;
+		offset.y = top;
+		offset.w = source.w;
+		offset.h = source.h;
+
+		// Both rects are already clipped so the checks in SDL_BlitSurface can be skipped
+		SDL_LowerBlit(sprite.source, &source, destination, &offset);
+	}
+
+	sprites.clear();
 }
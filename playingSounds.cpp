@@ -9,16 +9,30 @@
 #include "SDL_ttf.h"
 #include "SDL_image.h"
 #include <string>
+#include <list>
+#include <map>
+#include <vector>
 
 // Constants
 int const SCREEN_WIDTH = 640;
 int const SCREEN_HEIGHT = 480;
 int const SCREEN_BPP = 32;
 
+// The most bytes of rendered text kept around
+int const TEXT_CACHE_BUDGET = 1024 * 1024;
+
+// The number of threads decoding files
+int const LOADER_THREADS = 4;
+
+// The kinds of file the loader decodes
+int const ASSET_IMAGE = 0;
+int const ASSET_FONT = 1;
+int const ASSET_SOUND = 2;
+int const ASSET_MUSIC = 3;
+
 // The surfaces
 SDL_Surface *screen = NULL;
 SDL_Surface *background = NULL;
-SDL_Surface *message = NULL;
 
 // Events
 SDL_Event event;
@@ -27,6 +41,143 @@ SDL_Event event;
 TTF_Font *font = NULL;
 SDL_Color textColor = {0, 0, 0};
 
+// Rendered text surfaces kept by font, string and color, least recently used are freed once over the memory budget
+class TextCache
+{
+  public:
+	// Sets the memory budget in bytes
+	TextCache(int budget);
+
+	// Gets the rendered string, rendering it on a miss. The surface belongs to the cache and stays valid until the next get
+	SDL_Surface *get(TTF_Font *font, std::string text, SDL_Color color);
+
+	// Frees every cached surface
+	void clear();
+
+	// Gets the lookup counters
+	int get_hits();
+	int get_misses();
+
+	// Gets the bytes of pixels held
+	int get_bytes();
+
+  private:
+	// What a rendered string is looked up by
+	struct Key
+	{
+		TTF_Font *font;
+		Uint32 color;
+		std::string text;
+
+		bool operator<(const Key &other) const;
+	};
+
+	// A rendered string
+	struct Entry
+	{
+		Key key;
+		SDL_Surface *surface;
+		int bytes;
+	};
+
+	// The entries, most recently used first
+	std::list<Entry> entries;
+
+	// Where each key's entry is in the list
+	std::map<Key, std::list<Entry>::iterator> lookup;
+
+	// The memory budget and use
+	int budget;
+	int bytes;
+
+	// The lookup counters
+	int hits;
+	int misses;
+
+	// Frees least recently used entries until under budget, keeping the most recent one
+	void evict();
+};
+
+// The rendered labels
+TextCache labels(TEXT_CACHE_BUDGET);
+
+// Decodes files on a pool of threads, each queued file gets a handle to collect it with
+class AssetLoader
+{
+  public:
+	// Initializes the variables
+	AssetLoader();
+
+	// Starts the threads
+	bool start(int threads);
+
+	// Lets the threads finish the queue and waits for them
+	void stop();
+
+	// Queue files to be decoded and get their handles
+	int queue_image(std::string path);
+	int queue_font(std::string path, int size);
+	int queue_sound(std::string path);
+	int queue_music(std::string path);
+
+	// Checks if a file has been decoded
+	bool is_ready(int handle);
+
+	// Wait for a file and collect it, each handle can only be collected once
+	SDL_Surface *get_image(int handle);
+	TTF_Font *get_font(int handle);
+	Mix_Chunk *get_sound(int handle);
+	Mix_Music *get_music(int handle);
+
+  private:
+	// A file to decode
+	struct Job
+	{
+		int type;
+		std::string path;
+		int size;
+		bool done;
+
+		// What was decoded
+		SDL_Surface *image;
+		TTF_Font *font;
+		Mix_Chunk *sound;
+		Mix_Music *music;
+	};
+
+	// Every file queued, handles index into it
+	std::vector<Job> jobs;
+
+	// The next job to hand to a thread
+	unsigned int next;
+
+	// Set when the threads should finish up
+	bool stopping;
+
+	// Guards the jobs, signaled when jobs are queued and when they're done
+	SDL_mutex *lock;
+	SDL_cond *queued;
+	SDL_cond *finished;
+
+	// FreeType can't open faces from two threads at once
+	SDL_mutex *fontLock;
+
+	// The threads
+	std::vector<SDL_Thread *> workers;
+
+	// Queues a job and gets its handle
+	int queue(int type, std::string path, int size);
+
+	// Waits for a job to be done
+	void wait(int handle);
+
+	// Runs on each thread decoding jobs until stopped
+	static int work(void *data);
+};
+
+// The file loader
+AssetLoader loader;
+
 // The music to be played
 Mix_Music *music = NULL;
 
@@ -38,6 +189,7 @@ Mix_Chunk *low = NULL;
 
 // Function prototypes
 SDL_Surface *load_image(std::string filename);
+SDL_Surface *optimize_image(SDL_Surface *loadedImage);
 void apply_surface(int x, int y, SDL_Surface* source, SDL_Surface* destinaion);
 bool load_files();
 bool init();
@@ -60,8 +212,8 @@ int main(int argc, char* args[])
 	// Apply the background
 	apply_surface(0, 0, background, screen);
 
-	// Render the text
-	message = TTF_RenderText_Solid(font, "Press 1, 2, 3,  or 4 to play a sound effect", textColor);
+	// Get the rendered text
+	SDL_Surface *message = labels.get(font, "Press 1, 2, 3,  or 4 to play a sound effect", textColor);
 	
 	// If there was an error rendering the text
 	if(message == NULL)
@@ -71,12 +223,9 @@ int main(int argc, char* args[])
 
 	// Show the message on the screen
 	apply_surface((SCREEN_WIDTH - message->w)/2, 100, message, screen);
-
-	// Free the message
-	SDL_FreeSurface(message);
 	
-	// Render the text
-	message = TTF_RenderText_Solid(font, "Press 9 to play or puase the music", textColor);
+	// Get the rendered text
+	message = labels.get(font, "Press 9 to play or puase the music", textColor);
 
 	// If there was an error rendering the text
 	if(message == NULL)
@@ -87,11 +236,8 @@ int main(int argc, char* args[])
     //Show the message on the screen
 	apply_surface((SCREEN_WIDTH - message->w)/2, 200, message, screen);
 	
-	// Free the message
-	SDL_FreeSurface(message);
-
-	// Render the text
-	message = TTF_RenderText_Solid(font, "Press 0 to stop the music", textColor);
+	// Get the rendered text
+	message = labels.get(font, "Press 0 to stop the music", textColor);
 
 	// If there was an error rendering the text
 	if(message == NULL)
@@ -102,9 +248,6 @@ int main(int argc, char* args[])
 	// Show the message on the screen
 	apply_surface((SCREEN_WIDTH - message->w)/2, 300, message, screen);
 
-	// Free the message
-	SDL_FreeSurface(message);
-
 	if(SDL_Flip(screen) == -1)
 	{
 		return 6;
@@ -218,21 +361,29 @@ SDL_Surface *load_image(std::string filename)
 	if(loadedImage != NULL)
 	{
 		// Create optimized image
-		optimizedImage = SDL_DisplayFormat(loadedImage);
-	
-		// Free unneeded pointer
-		SDL_FreeSurface(loadedImage);
-		
-		if(optimizedImage != NULL)
-		{
-			SDL_SetColorKey(optimizedImage, SDL_SRCCOLORKEY, SDL_MapRGB(optimizedImage->format, 0, 0xFF, 0xFF));
-		}
+		optimizedImage = optimize_image(loadedImage);
 	}
 
 	// Return loaded image after being optimized
 	return optimizedImage;
 }
 
+SDL_Surface *optimize_image(SDL_Surface *loadedImage)
+{
+	// Create optimized image, this needs the screen so it has to run on the main thread
+	SDL_Surface* optimizedImage = SDL_DisplayFormat(loadedImage);
+
+	// Free unneeded pointer
+	SDL_FreeSurface(loadedImage);
+
+	if(optimizedImage != NULL)
+	{
+		SDL_SetColorKey(optimizedImage, SDL_SRCCOLORKEY, SDL_MapRGB(optimizedImage->format, 0, 0xFF, 0xFF));
+	}
+
+	return optimizedImage;
+}
+
 
 void apply_surface(int x, int y, SDL_Surface* source, SDL_Surface* destination)
 {
@@ -249,11 +400,23 @@ void apply_surface(int x, int y, SDL_Surface* source, SDL_Surface* destination)
 
 bool load_files()
 {
-	// Load the background image
-	background = load_image("background.png");
-
-	// Open the font
-	font = TTF_OpenFont("lazy.ttf", 30);
+	// Queue every file so they all decode at once
+	int backgroundFile = loader.queue_image("background.png");
+	int fontFile = loader.queue_font("lazy.ttf", 30);
+	int musicFile = loader.queue_music("beat.wav");
+	int scratchFile = loader.queue_sound("scratch.wav");
+	int highFile = loader.queue_sound("high.wav");
+	int medFile = loader.queue_sound("medium.wav");
+	int lowFile = loader.queue_sound("low.wav");
+
+	// Collect everything so nothing is left behind if a file failed
+	background = loader.get_image(backgroundFile);
+	font = loader.get_font(fontFile);
+	music = loader.get_music(musicFile);
+	scratch = loader.get_sound(scratchFile);
+	high = loader.get_sound(highFile);
+	med = loader.get_sound(medFile);
+	low = loader.get_sound(lowFile);
 
 	// If there was a problem in loading the background
 	if(background == NULL)
@@ -267,21 +430,12 @@ bool load_files()
 		return false;
 	}
 
-	// Load the music
-	music = Mix_LoadMUS("beat.wav");
-
 	// If there was a problem loading the music
 	if(music == NULL)
 	{
 		return false;
 	}
 
-	// Load the sound effects
-	scratch = Mix_LoadWAV("scratch.wav");
-	high = Mix_LoadWAV("high.wav");
-	med = Mix_LoadWAV("medium.wav");
-	low = Mix_LoadWAV("low.wav");
-
 	// If there was a problem loading the sound effects
 	if((scratch == NULL) || (high == NULL) || (med == NULL) || (low == NULL))
 	{
@@ -321,6 +475,12 @@ bool init()
 		return false;
 	}
 
+	// Start the file loader
+	if(loader.start(LOADER_THREADS) == false)
+	{
+		return false;
+	}
+
 	// Set the window caption
 	SDL_WM_SetCaption("Monitor Music", NULL);
 
@@ -331,9 +491,16 @@ bool init()
 
 void clean_up()
 {
+	// Stop the file loader
+	loader.stop();
+
 	// Free the surfaces
 	SDL_FreeSurface(background);
 
+	// Say how well the text cache did before it's emptied
+	std::cerr << "Text cache: " << labels.get_hits() << " hits, " << labels.get_misses() << " misses, " << labels.get_bytes() << " bytes held" << std::endl;
+	labels.clear();
+
 	// Free the sound effects
 	Mix_FreeChunk(scratch);
 	Mix_FreeChunk(high);
@@ -355,3 +522,352 @@ void clean_up()
 	// Quit SDL
 	SDL_Quit();
 }
+
+TextCache::TextCache(int budget)
+{
+	// Initialize the variables
+	this->budget = budget;
+	bytes = 0;
+	hits = 0;
+	misses = 0;
+}
+
+bool TextCache::Key::operator<(const Key &other) const
+{
+	if(font != other.font)
+	{
+		return font < other.font;
+	}
+	if(color != other.color)
+	{
+		return color < other.color;
+	}
+	return text < other.text;
+}
+
+SDL_Surface *TextCache::get(TTF_Font *font, std::string text, SDL_Color color)
+{
+	Key key;
+	key.font = font;
+	key.color = (color.r << 16) | (color.g << 8) | color.b;
+	key.text = text;
+
+	// If the string has been rendered already
+	std::map<Key, std::list<Entry>::iterator>::iterator found = lookup.find(key);
+	if(found != lookup.end())
+	{
+		hits++;
+
+		// Move it to the front as the most recently used
+		entries.splice(entries.begin(), entries, found->second);
+		return found->second->surface;
+	}
+
+	misses++;
+
+	// Render the string
+	SDL_Surface *surface = TTF_RenderText_Solid(font, text.c_str(), color);
+
+	// If there was an error rendering the text
+	if(surface == NULL)
+	{
+		return NULL;
+	}
+
+	// Keep it at the front
+	Entry entry;
+	entry.key = key;
+	entry.surface = surface;
+	entry.bytes = surface->pitch * surface->h;
+	entries.push_front(entry);
+	lookup[key] = entries.begin();
+	bytes += entry.bytes;
+
+	// Make room for it
+	evict();
+
+	return surface;
+}
+
+void TextCache::evict()
+{
+	// Free from the back until under budget, never the entry just used
+	while((bytes > budget) && (entries.size() > 1))
+	{
+		Entry &last = entries.back();
+		bytes -= last.bytes;
+		SDL_FreeSurface(last.surface);
+		lookup.erase(last.key);
+		entries.pop_back();
+	}
+}
+
+void TextCache::clear()
+{
+	// Free the surfaces
+	for(std::list<Entry>::iterator entry = entries.begin(); entry != entries.end(); entry++)
+	{
+		SDL_FreeSurface(entry->surface);
+	}
+	entries.clear();
+	lookup.clear();
+	bytes = 0;
+}
+
+int TextCache::get_hits()
+{
+	return hits;
+}
+
+int TextCache::get_misses()
+{
+	return misses;
+}
+
+int TextCache::get_bytes()
+{
+	return bytes;
+}
+
+AssetLoader::AssetLoader()
+{
+	// Initialize the variables
+	next = 0;
+	stopping = false;
+	lock = NULL;
+	queued = NULL;
+	finished = NULL;
+	fontLock = NULL;
+}
+
+bool AssetLoader::start(int threads)
+{
+	// Create the locks
+	lock = SDL_CreateMutex();
+	fontLock = SDL_CreateMutex();
+	queued = SDL_CreateCond();
+	finished = SDL_CreateCond();
+
+	if((lock == NULL) || (fontLock == NULL) || (queued == NULL) || (finished == NULL))
+	{
+		return false;
+	}
+
+	// Start the threads
+	for(int i = 0; i < threads; i++)
+	{
+		SDL_Thread *worker = SDL_CreateThread(work, this);
+		if(worker == NULL)
+		{
+			return false;
+		}
+		workers.push_back(worker);
+	}
+
+	return true;
+}
+
+void AssetLoader::stop()
+{
+	// If the loader never started
+	if(lock == NULL)
+	{
+		return;
+	}
+
+	// Tell the threads to finish
+	SDL_mutexP(lock);
+	stopping = true;
+	SDL_CondBroadcast(queued);
+	SDL_mutexV(lock);
+
+	// Wait for them
+	for(unsigned int i = 0; i < workers.size(); i++)
+	{
+		SDL_WaitThread(workers[i], NULL);
+	}
+	workers.clear();
+
+	// Free the locks
+	SDL_DestroyCond(queued);
+	SDL_DestroyCond(finished);
+	SDL_DestroyMutex(fontLock);
+	SDL_DestroyMutex(lock);
+	lock = NULL;
+}
+
+int AssetLoader::queue(int type, std::string path, int size)
+{
+	Job job;
+	job.type = type;
+	job.path = path;
+	job.size = size;
+	job.done = false;
+	job.image = NULL;
+	job.font = NULL;
+	job.sound = NULL;
+	job.music = NULL;
+
+	// Add the job and wake a thread for it
+	SDL_mutexP(lock);
+	int handle = jobs.size();
+	jobs.push_back(job);
+	SDL_CondSignal(queued);
+	SDL_mutexV(lock);
+
+	return handle;
+}
+
+int AssetLoader::queue_image(std::string path)
+{
+	return queue(ASSET_IMAGE, path, 0);
+}
+
+int AssetLoader::queue_font(std::string path, int size)
+{
+	return queue(ASSET_FONT, path, size);
+}
+
+int AssetLoader::queue_sound(std::string path)
+{
+	return queue(ASSET_SOUND, path, 0);
+}
+
+int AssetLoader::queue_music(std::string path)
+{
+	return queue(ASSET_MUSIC, path, 0);
+}
+
+bool AssetLoader::is_ready(int handle)
+{
+	SDL_mutexP(lock);
+	bool done = jobs[handle].done;
+	SDL_mutexV(lock);
+
+	return done;
+}
+
+void AssetLoader::wait(int handle)
+{
+	// Sleep until a thread says the job is done
+	SDL_mutexP(lock);
+	while(jobs[handle].done == false)
+	{
+		SDL_CondWait(finished, lock);
+	}
+	SDL_mutexV(lock);
+}
+
+SDL_Surface *AssetLoader::get_image(int handle)
+{
+	wait(handle);
+
+	// Take the decoded image
+	SDL_mutexP(lock);
+	SDL_Surface *loadedImage = jobs[handle].image;
+	jobs[handle].image = NULL;
+	SDL_mutexV(lock);
+
+	// If the image didn't load
+	if(loadedImage == NULL)
+	{
+		return NULL;
+	}
+
+	// Convert it to the screen's format here on the main thread
+	return optimize_image(loadedImage);
+}
+
+TTF_Font *AssetLoader::get_font(int handle)
+{
+	wait(handle);
+
+	SDL_mutexP(lock);
+	TTF_Font *font = jobs[handle].font;
+	jobs[handle].font = NULL;
+	SDL_mutexV(lock);
+
+	return font;
+}
+
+Mix_Chunk *AssetLoader::get_sound(int handle)
+{
+	wait(handle);
+
+	SDL_mutexP(lock);
+	Mix_Chunk *sound = jobs[handle].sound;
+	jobs[handle].sound = NULL;
+	SDL_mutexV(lock);
+
+	return sound;
+}
+
+Mix_Music *AssetLoader::get_music(int handle)
+{
+	wait(handle);
+
+	SDL_mutexP(lock);
+	Mix_Music *music = jobs[handle].music;
+	jobs[handle].music = NULL;
+	SDL_mutexV(lock);
+
+	return music;
+}
+
+int AssetLoader::work(void *data)
+{
+	AssetLoader *loader = (AssetLoader *)data;
+
+	SDL_mutexP(loader->lock);
+	while(true)
+	{
+		// Sleep until there's a job or it's time to stop
+		while((loader->next == loader->jobs.size()) && (loader->stopping == false))
+		{
+			SDL_CondWait(loader->queued, loader->lock);
+		}
+
+		// If the queue is empty it's time to stop
+		if(loader->next == loader->jobs.size())
+		{
+			break;
+		}
+
+		// Take the next job, the vector can grow while we're unlocked so copy what's needed
+		int handle = loader->next;
+		loader->next++;
+		Job job = loader->jobs[handle];
+		SDL_mutexV(loader->lock);
+
+		// Decode the file without holding the lock
+		switch(job.type)
+		{
+			case ASSET_IMAGE:
+				job.image = IMG_Load(job.path.c_str());
+				break;
+
+			case ASSET_FONT:
+				SDL_mutexP(loader->fontLock);
+				job.font = TTF_OpenFont(job.path.c_str(), job.size);
+				SDL_mutexV(loader->fontLock);
+				break;
+
+			case ASSET_SOUND:
+				job.sound = Mix_LoadWAV(job.path.c_str());
+				break;
+
+			case ASSET_MUSIC:
+				job.music = Mix_LoadMUS(job.path.c_str());
+				break;
+		}
+
+		// Hand back the result and wake anyone waiting for it
+		SDL_mutexP(loader->lock);
+		job.done = true;
+		loader->jobs[handle] = job;
+		SDL_CondBroadcast(loader->finished);
+	}
+	SDL_mutexV(loader->lock);
+
+	return 0;
+}
@@ -2,7 +2,24 @@
 #include "SDL/SDL.h"
 #include "SDL/SDL_image.h"
 #include <string>
+#include <chrono>
+#include <thread>
 #include <iostream> 
+#include <cstring>
+#include <cstdlib>
+#include <vector>
+#include <iomanip>
+#include <map>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 // The screen attributes
 const int SCREEN_WIDTH = 640;
@@ -13,13 +30,47 @@ const int SCREEN_BPP = 32;
 const int DOT_WIDTH = 20;
 const int DOT_HEIGHT = 20;
 
-// The dimensions of the level
+// A position or speed with 16 bits of it after the point, so things can move by fractions of a pixel without floating point
+// 64 bits leave room for levels far wider than 16.16 in 32 bits would reach
+typedef Sint64 Fixed;
+const int FIXED_SHIFT = 16;
+const Fixed FIXED_ONE = (Fixed)1 << FIXED_SHIFT;
+
+// How fast the dot moves in a frame, it can be a fraction of a pixel
+const Fixed DOT_SPEED = FIXED_ONE * DOT_WIDTH / 2;
+
+// The dimensions of the level when it's one background image
 const int LEVEL_WIDTH = 1280;
 const int LEVEL_HEIGHT = 960;
 
+// The tile number of a tile with nothing in it
+const Uint16 MAP_EMPTY = 0xFFFF;
+
+// The first bytes of a map file
+const char MAP_MAGIC[4] = {'M', 'A', 'P', '1'};
+
+// How many frames ahead the level streamer looks along the dot's path
+const int STREAM_LOOKAHEAD = 30;
+
+// How many chunks round the camera's path the streamer keeps loaded
+const int STREAM_MARGIN = 1;
+
+// The bytes of tiles the streamer keeps loaded before it unloads chunks far from the camera
+const int STREAM_BUDGET = 64 * 1024;
+
 // The frame rate
 const int FRAMES_PER_SECOND = 20;
 
+// How long before a deadline the frame pacer stops sleeping and spins, in milliseconds
+const double PACER_SPIN_TIME = 2.0;
+
+// The ways the screen can be drawn to
+const int RENDER_SOFTWARE = 0;
+const int RENDER_HARDWARE = 1;
+
+// How many frames a benchmark sweeps the dot one way before turning around
+const int BENCH_SWEEP_FRAMES = 128;
+
 // The surfaces
 SDL_Surface *dot = NULL;
 SDL_Surface *background = NULL;
@@ -28,8 +79,23 @@ SDL_Surface *screen = NULL;
 // The event structure
 SDL_Event event;
 
+// A view of the level, in level coordinates that can run past what an SDL_Rect holds
+struct Camera
+{
+	// Where it is to a fraction of a pixel
+	Fixed fixedX, fixedY;
+
+	// Where it's drawn from, snapped to the pixel
+	int x, y;
+	int w, h;
+};
+
 // The camera
-SDL_Rect camera = {0, 0, SCREEN_WIDTH, SCREEN_HEIGHT};
+Camera camera = {0, 0, 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT};
+
+// The dimensions of the level being played
+int levelWidth = LEVEL_WIDTH;
+int levelHeight = LEVEL_HEIGHT;
 
 // The dot
 class Dot
@@ -49,13 +115,17 @@ class Dot
 
 		// Sets the camera over the dot
 		void set_camera();
+
+		// Gets the velocity of the dot in whole pixels
+		int get_x_velocity();
+		int get_y_velocity();
 		
 	private:
 		// The x and y offsets of the dot
-		int x, y;
+		Fixed x, y;
 
 		// The velocity of the dot
-		int xVel, yVel;
+		Fixed xVel, yVel;
 };
 
 // The timer
@@ -68,37 +138,315 @@ class Timer
 		void pause();
 		void unpause();
 
-		int get_ticks();
+		double get_ticks();
+		std::chrono::nanoseconds get_time();
 
 		bool is_started();
 		bool is_paused();
 
 	private:
-		int startTicks;
-		int pausedTicks;
+		std::chrono::steady_clock::time_point startTime;
+		std::chrono::nanoseconds pausedTime;
 
 		bool paused;
 		bool started;
 };
 
+// Holds frames to a fixed rate against a running deadline
+class FramePacer
+{
+	public:
+		// Sets the frame rate to pace to
+		FramePacer(int framesPerSecond);
+
+		// Sets the first deadline one frame from now
+		void start();
+
+		// Waits for the current deadline and moves it on by one frame
+		void wait();
+
+		// Gets the number of deadlines that had already passed when waited on
+		int get_missed();
+
+	private:
+		// The time since pacing started
+		Timer clock;
+
+		// The length of a frame in milliseconds
+		double frameLength;
+
+		// When the current frame should end
+		double deadline;
+
+		// The number of missed deadlines
+		int missed;
+};
+
+// Opens the screen and prepares images for one of the rendering backends
+class Renderer
+{
+	public:
+		// Initializes the variables
+		Renderer();
+
+		// Opens the screen with the backend, falls back to software if video memory isn't available
+		SDL_Surface *open(int width, int height, int bpp, int backend);
+
+		// Gets the backend in use
+		int get_backend();
+
+		// Gets the name of the backend in use
+		const char *get_name();
+
+		// Converts a loaded image to the format and memory the backend blits fastest from, freeing the original
+		SDL_Surface *prepare(SDL_Surface *image);
+
+		// Shows the finished frame
+		bool present();
+
+	private:
+		// The screen surface
+		SDL_Surface *screen;
+
+		// The backend in use
+		int backend;
+};
+
+// Runs the main loop headless and uncapped for a set number of frames and reports the frame rate
+class Benchmark
+{
+	public:
+		// Initializes the variables
+		Benchmark();
+
+		// Reads -frames N and -checksum from the command line
+		void parse(int argc, char *args[]);
+
+		// Checks if a benchmark was asked for
+		bool is_running();
+
+		// Feeds the dot key presses that sweep it across the level
+		void drive();
+
+		// Counts a finished frame and checksums it if asked, returns false once all the frames are done
+		bool frame_done(SDL_Surface *screen);
+
+		// Prints the frame rate and checksums
+		void report();
+
+	private:
+		// The frames to run and the frames done
+		int frames;
+		int done;
+
+		// Whether to checksum each frame
+		bool checksum;
+
+		// The checksum of each frame
+		std::vector<Uint32> sums;
+
+		// The time since the first frame finished
+		Timer clock;
+
+		// Presses or releases the arrow keys for the sweep direction
+		void push_keys(Uint8 type, bool forward);
+};
+
+// Loaded images shared by path, each is freed when the last user releases it
+class ImageCache
+{
+	public:
+		// Gets the image for the path, loading it the first time. Every image gotten must be released
+		SDL_Surface *get(std::string path);
+
+		// Gives up a use of the image, freeing it if it was the last one
+		void release(SDL_Surface *image);
+
+		// Gets the number of images loaded
+		int get_count();
+
+	private:
+		// A loaded image and how many are using it
+		struct Entry
+		{
+			SDL_Surface *image;
+			int uses;
+		};
+
+		// The images by path
+		std::map<std::string, Entry> images;
+
+		// The path each image was loaded from
+		std::map<SDL_Surface *, std::string> paths;
+};
+
+// The header at the start of a map file from mapPacker, followed by the chunks of Uint16 tile numbers
+struct MapHeader
+{
+	char magic[4];
+	Uint32 tileSize;
+	Uint32 chunkTiles;
+	Uint32 width, height;
+	Uint32 chunksAcross, chunksDown;
+	Uint32 chunkOffset;
+	char tileset[64];
+};
+
+// A level made of tiles from a tileset, kept in square chunks so only the ones in view are drawn
+// The map file is mapped rather than read, and a thread copies in the chunks the camera is near or heading for
+class TileMap
+{
+	public:
+		// Initializes the variables
+		TileMap();
+
+		// Maps the map, loads its tileset and starts the streaming thread, returns false if any of it failed
+		bool load(std::string filename);
+
+		// Stops the thread, frees the chunks, unmaps the map and gives up the tileset
+		void clear();
+
+		// Gets the size of the level in pixels
+		int get_width();
+		int get_height();
+
+		// Asks for the chunks around the camera and ahead of it at the velocity, and unloads far ones over the budget
+		void stream(Camera *camera, int xVel, int yVel);
+
+		// Draws the part of the level under the camera
+		void draw(Camera *camera, SDL_Surface *destination);
+
+		// Gets the bytes of tiles loaded, and how many chunks had to be loaded while drawing
+		int get_bytes();
+		int get_misses();
+
+	private:
+		// A chunk's tiles if they're loaded, and the last stream they were wanted in
+		struct Chunk
+		{
+			Uint16 *tiles;
+			int wanted;
+		};
+
+		// The size of a tile in pixels and of a chunk in tiles
+		int tileSize;
+		int chunkTiles;
+
+		// The size of the level in tiles, and in chunks
+		int width, height;
+		int chunksAcross, chunksDown;
+
+		// The mapped file and where its chunks start
+		void *data;
+		size_t size;
+		Uint32 chunkOffset;
+
+		// Every chunk, and the ones loaded
+		std::vector<Chunk> chunks;
+		std::vector<int> loaded;
+		int bytes;
+
+		// The number of times stream was called
+		int streams;
+
+		// The chunks drawn before they were streamed in
+		int misses;
+
+		// The tiles' pictures
+		SDL_Surface *tileset;
+		int tilesetColumns;
+
+		// The chunks for the thread to copy, the nearest last, the one it's copying and the ones it's done
+		std::vector<int> pending;
+		int busy;
+		std::vector<std::pair<int, Uint16 *> > done;
+
+		// Set when the thread should finish
+		bool stopping;
+
+		// Guards the lists above, signaled when there's more pending
+		SDL_mutex *lock;
+		SDL_cond *queued;
+
+		// The streaming thread
+		SDL_Thread *worker;
+
+		// Copies a chunk's tiles out of the mapped file
+		Uint16 *copy_chunk(int chunk);
+
+		// Takes a chunk in as loaded
+		void add_chunk(int chunk, Uint16 *tiles);
+
+		// Gets how far a chunk is from the camera's center, squared in chunks
+		int distance(int chunk, Camera *camera);
+
+		// Draws the tiles of a chunk that are under the camera
+		void draw_chunk(int chunkX, int chunkY, Camera *camera, SDL_Surface *destination);
+
+		// Maps the whole file read only
+		bool map_file(std::string filename);
+
+		// Unmaps the file
+		void unmap_file();
+
+		// Runs on the streaming thread copying pending chunks until stopped
+		static int work(void *data);
+};
+
+// The renderer
+Renderer renderer;
+
+// The loaded images
+ImageCache images;
+
+// The tiled level
+TileMap level;
 
 // Function Prototypes
-bool init();
+bool init(int backend);
 SDL_Surface *load_image(std::string file);
 void apply_surface(int x, int y, SDL_Surface *source, SDL_Surface *destination, SDL_Rect *clip = NULL);
+Fixed to_fixed(int pixels);
+int to_pixels(Fixed value);
 bool load_files();
 void clean_up();
 
-int main()
+int main(int argc, char *args[])
 {
 	// Quit flag
 	bool quit = false;
 
+	// Headless benchmark settings
+	Benchmark bench;
+	bench.parse(argc, args);
+
+	// Draw in software unless asked for hardware
+	int backend = RENDER_SOFTWARE;
+	for(int i = 1; i < argc; i++)
+	{
+		if(strcmp(args[i], "-hardware") == 0)
+		{
+			backend = RENDER_HARDWARE;
+		}
+		else if(strcmp(args[i], "-software") == 0)
+		{
+			backend = RENDER_SOFTWARE;
+		}
+	}
+
 	// Class instances
 	Dot myDot;
-	Timer fps;
+	FramePacer fps(FRAMES_PER_SECOND);
+
+	// A benchmark draws to an offscreen surface from the dummy video driver
+	if(bench.is_running() == true)
+	{
+		// putenv may keep the string rather than copy it
+		static char dummyDriver[] = "SDL_VIDEODRIVER=dummy";
+		SDL_putenv(dummyDriver);
+	}
 
-	if(init() == false)
+	if(init(backend) == false)
 	{
 		return 1;
 	}
@@ -108,11 +456,17 @@ int main()
 		return 1;
 	}
 
+	// Start pacing frames
+	fps.start();
+
 	// While the user has not quit
 	while(quit == false)
 	{
-		// Start the timer
-		fps.start();
+		// With nobody at the keyboard, script the input
+		if(bench.is_running() == true)
+		{
+			bench.drive();
+		}
 
 		// While the there's events to handle
 		while(SDL_PollEvent(&event))
@@ -134,22 +488,55 @@ int main()
 		// Set the camera
 		myDot.set_camera();
 
-		// Show the background
-		apply_surface(0, 0, background, screen, &camera);
+		// Stream in the level round the camera and where it's heading
+		level.stream(&camera, myDot.get_x_velocity(), myDot.get_y_velocity());
+
+		// Show the level
+		if(background == NULL)
+		{
+			// Empty tiles show black
+			SDL_FillRect(screen, NULL, SDL_MapRGB(screen->format, 0, 0, 0));
+			level.draw(&camera, screen);
+		}
+		else
+		{
+			SDL_Rect view = {(Sint16)camera.x, (Sint16)camera.y, (Uint16)camera.w, (Uint16)camera.h};
+			apply_surface(0, 0, background, screen, &view);
+		}
 
 		// Show the dot on the screen
 		myDot.show();
 		
 		// Update the screen
-		if(SDL_Flip(screen) == -1)
+		if(renderer.present() == false)
 		{
 			return 1;
 		}
 
-		// Cap the frame rate
-		if(fps.get_ticks() < 1000 / FRAMES_PER_SECOND)
+		// A benchmark runs uncapped until its frames are done
+		if(bench.is_running() == true)
+		{
+			if(bench.frame_done(screen) == false)
+			{
+				quit = true;
+			}
+		}
+		else
+		{
+			// Cap the frame rate
+			fps.wait();
+		}
+	}
+
+	// Print the results of a benchmark
+	if(bench.is_running() == true)
+	{
+		bench.report();
+
+		// Chunks drawn before they streamed in are load hitches
+		if(background == NULL)
 		{
-			SDL_Delay((1000 / FRAMES_PER_SECOND) - fps.get_ticks());
+			std::cout << "chunks loaded while drawing: " << level.get_misses() << std::endl;
 		}
 	}
 
@@ -157,21 +544,24 @@ int main()
 	return 0;
 }
 
-bool init()
+bool init(int backend)
 {
 	if(SDL_Init(SDL_INIT_EVERYTHING) == -1)
 	{
 		return false;
 	}
 
-	screen = SDL_SetVideoMode(SCREEN_WIDTH, SCREEN_HEIGHT, SCREEN_BPP, SDL_SWSURFACE);
+	screen = renderer.open(SCREEN_WIDTH, SCREEN_HEIGHT, SCREEN_BPP, backend);
 
 	if(screen ==  NULL)
 	{
 		return false;
 	}
 
-	SDL_WM_SetCaption("Scrolling", NULL);
+	// Show which backend is drawing
+	std::string caption = "Scrolling - ";
+	caption += renderer.get_name();
+	SDL_WM_SetCaption(caption.c_str(), NULL);
 	
 	return true;
 }
@@ -184,12 +574,8 @@ SDL_Surface *load_image(std::string file)
 	loadedImage = IMG_Load(file.c_str());
 	if(loadedImage != NULL)
 	{
-		optimizedImage = SDL_DisplayFormat(loadedImage);
-		SDL_FreeSurface(loadedImage);
-	}
-	if(optimizedImage != NULL)
-	{
-		SDL_SetColorKey(optimizedImage, SDL_SRCCOLORKEY, SDL_MapRGB(optimizedImage->format, 0, 0xFF, 0xFF));
+		// Let the renderer put the image where it blits fastest from
+		optimizedImage = renderer.prepare(loadedImage);
 	}
 
 	return optimizedImage;
@@ -203,15 +589,40 @@ void apply_surface(int x, int y, SDL_Surface *source, SDL_Surface *destination,
 
 	SDL_BlitSurface(source, clip, destination, &offset);
 }
+
+Fixed to_fixed(int pixels)
+{
+	return (Fixed)pixels * FIXED_ONE;
+}
+
+int to_pixels(Fixed value)
+{
+	// Round down, to the pixel the value is in
+	if(value < 0)
+	{
+		return -(int)((-value + FIXED_ONE - 1) / FIXED_ONE);
+	}
+	return (int)(value / FIXED_ONE);
+}
 	
 bool load_files()
 {
-	dot = load_image("dot.bmp");
+	dot = images.get("dot.bmp");
 	if(dot == NULL)
 	{
 		return false;
 	}
-	background = load_image("bg.png");
+
+	// Use the tiled level if there is one
+	if(level.load("level.map") == true)
+	{
+		levelWidth = level.get_width();
+		levelHeight = level.get_height();
+		return true;
+	}
+
+	// Otherwise the whole level is one image
+	background = images.get("bg.png");
 	
 	if(background == NULL)
 	{	
@@ -223,8 +634,9 @@ bool load_files()
 
 void clean_up()
 {
-	SDL_FreeSurface(dot);
-	SDL_FreeSurface(background);
+	level.clear();
+	images.release(dot);
+	images.release(background);
 	SDL_Quit();
 }
 Dot::Dot()
@@ -242,20 +654,20 @@ void Dot::handle_input()
 	{
 		switch(event.key.keysym.sym)
 		{
-			case SDLK_UP: yVel -= DOT_HEIGHT / 2; break;
-			case SDLK_DOWN: yVel += DOT_HEIGHT / 2; break;
-			case SDLK_LEFT: xVel -= DOT_WIDTH / 2; break;
-			case SDLK_RIGHT: xVel += DOT_WIDTH / 2; break;
+			case SDLK_UP: yVel -= DOT_SPEED; break;
+			case SDLK_DOWN: yVel += DOT_SPEED; break;
+			case SDLK_LEFT: xVel -= DOT_SPEED; break;
+			case SDLK_RIGHT: xVel += DOT_SPEED; break;
 		}
 	}
 	if(event.type == SDL_KEYUP)
 	{
 		switch(event.key.keysym.sym)
 		{
-			case SDLK_UP: yVel += DOT_HEIGHT / 2; break;
-			case SDLK_DOWN: yVel -= DOT_HEIGHT / 2; break;
-			case SDLK_LEFT: xVel += DOT_WIDTH / 2; break;
-			case SDLK_RIGHT: xVel -= DOT_WIDTH / 2; break;
+			case SDLK_UP: yVel += DOT_SPEED; break;
+			case SDLK_DOWN: yVel -= DOT_SPEED; break;
+			case SDLK_LEFT: xVel += DOT_SPEED; break;
+			case SDLK_RIGHT: xVel -= DOT_SPEED; break;
 		}
 	}
 }
@@ -266,7 +678,7 @@ void Dot::move()
 	x += xVel;
 
 	// if the dot went too far to the left or right
-	if((x < 0) || (x + DOT_WIDTH > LEVEL_WIDTH))
+	if((x < 0) || (x + to_fixed(DOT_WIDTH) > to_fixed(levelWidth)))
 	{
 		// Move back!
 		x -= xVel;
@@ -276,7 +688,7 @@ void Dot::move()
 	y += yVel;
 
 	// If the dot went too far up or down
-	if((y < 0) || (y + DOT_HEIGHT > LEVEL_HEIGHT))
+	if((y < 0) || (y + to_fixed(DOT_HEIGHT) > to_fixed(levelHeight)))
 	{
 		// Move back!
 		y -= yVel;
@@ -286,38 +698,52 @@ void Dot::move()
 void Dot::set_camera()
 {
 	// Center the camera over the dot
-	camera.x = (x + DOT_WIDTH / 2) - SCREEN_WIDTH / 2;
-	camera.y = (y + DOT_HEIGHT / 2) - SCREEN_HEIGHT / 2;
+	camera.fixedX = (x + to_fixed(DOT_WIDTH) / 2) - to_fixed(SCREEN_WIDTH) / 2;
+	camera.fixedY = (y + to_fixed(DOT_HEIGHT) / 2) - to_fixed(SCREEN_HEIGHT) / 2;
 
 	// Keep the camera in bounds
-	if(camera.x < 0)
+	if(camera.fixedX < 0)
 	{
-		camera.x = 0;
+		camera.fixedX = 0;
 	}
-	if(camera.y < 0)
+	if(camera.fixedY < 0)
 	{
-		camera.y = 0;
+		camera.fixedY = 0;
 	}
-	if(camera.x > LEVEL_WIDTH - camera.w)
+	if(camera.fixedX > to_fixed(levelWidth - camera.w))
 	{
-		camera.x = LEVEL_WIDTH - camera.w;
+		camera.fixedX = to_fixed(levelWidth - camera.w);
 	}
-	if(camera.y > LEVEL_HEIGHT - camera.h)
+	if(camera.fixedY > to_fixed(levelHeight - camera.h))
 	{
-		camera.y = LEVEL_HEIGHT - camera.h;
+		camera.fixedY = to_fixed(levelHeight - camera.h);
 	}
+
+	// Draw from the pixel it's in
+	camera.x = to_pixels(camera.fixedX);
+	camera.y = to_pixels(camera.fixedY);
+}
+
+int Dot::get_x_velocity()
+{
+	return to_pixels(xVel);
+}
+
+int Dot::get_y_velocity()
+{
+	return to_pixels(yVel);
 }
 
 void Dot::show()
 {
-	// Show the dot
-	apply_surface(x - camera.x, y -camera.y, dot, screen);
+	// Show the dot at the pixel it's in, so it keeps still against the level as the camera snaps
+	apply_surface(to_pixels(x) - camera.x, to_pixels(y) - camera.y, dot, screen);
 }
 
 Timer::Timer()
 {
-	startTicks = 0;
-	pausedTicks = 0;
+	startTime = std::chrono::steady_clock::time_point();
+	pausedTime = std::chrono::nanoseconds::zero();
 	started = false;
 	paused = false;
 }
@@ -328,7 +754,7 @@ void Timer::start()
 
 	paused = false;
 
-	startTicks = SDL_GetTicks();
+	startTime = std::chrono::steady_clock::now();
 }
 
 void Timer::stop()
@@ -342,7 +768,7 @@ void Timer::pause()
 	if((started == true) && (paused == false))
 	{
 		paused = true;
-		pausedTicks = SDL_GetTicks() - startTicks;
+		pausedTime = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime);
 	}
 }
 
@@ -351,28 +777,33 @@ void Timer::unpause()
 	if(paused == true)
 	{
 		paused = false;
-		startTicks = SDL_GetTicks() - pausedTicks;
+		startTime = std::chrono::steady_clock::now() - pausedTime;
 
-		pausedTicks = 0;
+		pausedTime = std::chrono::nanoseconds::zero();
 	}
 }
 
-int Timer::get_ticks()
+std::chrono::nanoseconds Timer::get_time()
 {
 	if(started == true)
 	{
 		if(paused == true)
 		{
-			return pausedTicks;
+			return pausedTime;
 		}
 
 		else
 		{
-			return SDL_GetTicks() - startTicks;
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime);
 		}
 	}
 
-	return 0;
+	return std::chrono::nanoseconds::zero();
+}
+
+double Timer::get_ticks()
+{
+	return std::chrono::duration<double, std::milli>(get_time()).count();
 }
 
 bool Timer::is_started()
@@ -384,3 +815,814 @@ bool Timer::is_paused()
 {
 	return paused;
 }
+
+FramePacer::FramePacer(int framesPerSecond)
+{
+	// Initialize the variables
+	frameLength = 1000.0 / framesPerSecond;
+	deadline = 0;
+	missed = 0;
+}
+
+void FramePacer::start()
+{
+	// Start the clock with the first frame due one frame from now
+	clock.start();
+	deadline = frameLength;
+}
+
+void FramePacer::wait()
+{
+	double now = clock.get_ticks();
+
+	// If the frame ran past its deadline
+	if(now > deadline)
+	{
+		missed++;
+
+		// If it's a whole frame behind, start over from now instead of rushing to catch up
+		if(now - deadline >= frameLength)
+		{
+			deadline = now;
+		}
+	}
+	else
+	{
+		// Sleep through most of the wait, the OS may wake us late
+		if(deadline - now > PACER_SPIN_TIME)
+		{
+			SDL_Delay((Uint32)(deadline - now - PACER_SPIN_TIME));
+		}
+
+		// Spin out the rest against the clock
+		while(clock.get_ticks() < deadline)
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	// The next deadline is one frame after this one, so lateness doesn't add up
+	deadline += frameLength;
+}
+
+int FramePacer::get_missed()
+{
+	return missed;
+}
+
+Renderer::Renderer()
+{
+	screen = NULL;
+	backend = RENDER_SOFTWARE;
+}
+
+SDL_Surface *Renderer::open(int width, int height, int bpp, int backend)
+{
+	screen = NULL;
+
+	// Try for a double buffered screen in video memory
+	if(backend == RENDER_HARDWARE)
+	{
+		screen = SDL_SetVideoMode(width, height, bpp, SDL_HWSURFACE | SDL_DOUBLEBUF);
+
+		// If the driver gave back a software screen there's nothing to gain
+		if((screen != NULL) && ((screen->flags & SDL_HWSURFACE) == 0))
+		{
+			screen = NULL;
+		}
+	}
+
+	// Fall back to drawing in system memory
+	if(screen == NULL)
+	{
+		backend = RENDER_SOFTWARE;
+		screen = SDL_SetVideoMode(width, height, bpp, SDL_SWSURFACE);
+	}
+
+	this->backend = backend;
+	return screen;
+}
+
+int Renderer::get_backend()
+{
+	return backend;
+}
+
+const char *Renderer::get_name()
+{
+	if(backend == RENDER_HARDWARE)
+	{
+		return "hardware";
+	}
+	return "software";
+}
+
+SDL_Surface *Renderer::prepare(SDL_Surface *image)
+{
+	// With a hardware screen this puts the copy in video memory if there's room
+	SDL_Surface *prepared = SDL_DisplayFormat(image);
+	SDL_FreeSurface(image);
+
+	if(prepared != NULL)
+	{
+		Uint32 key = SDL_MapRGB(prepared->format, 0, 0xFF, 0xFF);
+
+		// RLE would pull the surface back into system memory, only use it when blitting in software
+		if(backend == RENDER_HARDWARE)
+		{
+			SDL_SetColorKey(prepared, SDL_SRCCOLORKEY, key);
+		}
+		else
+		{
+			SDL_SetColorKey(prepared, SDL_SRCCOLORKEY | SDL_RLEACCEL, key);
+		}
+	}
+
+	return prepared;
+}
+
+bool Renderer::present()
+{
+	// Swaps the buffers on a hardware screen, copies the whole frame out on a software one
+	return SDL_Flip(screen) != -1;
+}
+
+Benchmark::Benchmark()
+{
+	frames = 0;
+	done = 0;
+	checksum = false;
+}
+
+void Benchmark::parse(int argc, char *args[])
+{
+	for(int i = 1; i < argc; i++)
+	{
+		if((strcmp(args[i], "-frames") == 0) && (i + 1 < argc))
+		{
+			frames = atoi(args[i + 1]);
+			i++;
+		}
+		else if(strcmp(args[i], "-checksum") == 0)
+		{
+			checksum = true;
+		}
+	}
+}
+
+bool Benchmark::is_running()
+{
+	return frames > 0;
+}
+
+void Benchmark::push_keys(Uint8 type, bool forward)
+{
+	SDL_Event key;
+	key.type = type;
+
+	key.key.keysym.sym = forward ? SDLK_RIGHT : SDLK_LEFT;
+	SDL_PushEvent(&key);
+
+	key.key.keysym.sym = forward ? SDLK_DOWN : SDLK_UP;
+	SDL_PushEvent(&key);
+}
+
+void Benchmark::drive()
+{
+	// Turn the dot around at the end of each sweep
+	if(done % BENCH_SWEEP_FRAMES == 0)
+	{
+		bool forward = (done / BENCH_SWEEP_FRAMES) % 2 == 0;
+
+		if(done > 0)
+		{
+			push_keys(SDL_KEYUP, !forward);
+		}
+		push_keys(SDL_KEYDOWN, forward);
+	}
+}
+
+bool Benchmark::frame_done(SDL_Surface *screen)
+{
+	// Start the clock once the first frame is finished, so loading it isn't counted
+	if(done == 0)
+	{
+		clock.start();
+	}
+
+	if(checksum == true)
+	{
+		// FNV-1a over the visible pixels, skipping any row padding
+		Uint32 sum = 2166136261u;
+
+		if(SDL_MUSTLOCK(screen))
+		{
+			SDL_LockSurface(screen);
+		}
+
+		int rowBytes = screen->w * screen->format->BytesPerPixel;
+		for(int y = 0; y < screen->h; y++)
+		{
+			Uint8 *row = (Uint8 *)screen->pixels + y * screen->pitch;
+			for(int x = 0; x < rowBytes; x++)
+			{
+				sum = (sum ^ row[x]) * 16777619u;
+			}
+		}
+
+		if(SDL_MUSTLOCK(screen))
+		{
+			SDL_UnlockSurface(screen);
+		}
+
+		sums.push_back(sum);
+	}
+
+	done++;
+	return done < frames;
+}
+
+void Benchmark::report()
+{
+	double ticks = clock.get_ticks();
+
+	// Checksums first so they can be diffed against an earlier run
+	for(unsigned int i = 0; i < sums.size(); i++)
+	{
+		std::cout << "frame " << i << " checksum " << std::hex << std::setw(8) << std::setfill('0') << sums[i] << std::dec << std::endl;
+	}
+
+	// Timed from the end of the first frame, so it's the frames after it that count
+	std::cout << "frames: " << done << " time: " << ticks << " ms";
+	if((done > 1) && (ticks > 0))
+	{
+		std::cout << " fps: " << (done - 1) * 1000.0 / ticks;
+	}
+	std::cout << std::endl;
+}
+
+SDL_Surface *ImageCache::get(std::string path)
+{
+	// If the image is loaded already, share it
+	std::map<std::string, Entry>::iterator found = images.find(path);
+	if(found != images.end())
+	{
+		found->second.uses++;
+		return found->second.image;
+	}
+
+	// Load and convert it the first time
+	SDL_Surface *image = load_image(path);
+	if(image == NULL)
+	{
+		return NULL;
+	}
+
+	Entry entry;
+	entry.image = image;
+	entry.uses = 1;
+	images[path] = entry;
+	paths[image] = path;
+
+	return image;
+}
+
+void ImageCache::release(SDL_Surface *image)
+{
+	// If the image didn't come from the cache
+	std::map<SDL_Surface *, std::string>::iterator path = paths.find(image);
+	if(path == paths.end())
+	{
+		return;
+	}
+
+	// If that was the last use, free it
+	std::map<std::string, Entry>::iterator found = images.find(path->second);
+	found->second.uses--;
+	if(found->second.uses == 0)
+	{
+		SDL_FreeSurface(image);
+		images.erase(found);
+		paths.erase(path);
+	}
+}
+
+int ImageCache::get_count()
+{
+	return images.size();
+}
+
+TileMap::TileMap()
+{
+	tileSize = 0;
+	chunkTiles = 0;
+	width = 0;
+	height = 0;
+	chunksAcross = 0;
+	chunksDown = 0;
+	data = NULL;
+	size = 0;
+	chunkOffset = 0;
+	bytes = 0;
+	streams = 0;
+	misses = 0;
+	tileset = NULL;
+	tilesetColumns = 0;
+	busy = -1;
+	stopping = false;
+	lock = NULL;
+	queued = NULL;
+	worker = NULL;
+}
+
+bool TileMap::map_file(std::string filename)
+{
+#ifdef _WIN32
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+	if(GetFileSizeEx(file, &fileSize) == 0)
+	{
+		CloseHandle(file);
+		return false;
+	}
+	size = (size_t)fileSize.QuadPart;
+
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);
+	if(mapping == NULL)
+	{
+		return false;
+	}
+
+	// The view keeps the mapping alive
+	data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+#else
+	int file = ::open(filename.c_str(), O_RDONLY);
+	if(file == -1)
+	{
+		return false;
+	}
+
+	struct stat info;
+	if((fstat(file, &info) == -1) || (info.st_size == 0))
+	{
+		::close(file);
+		return false;
+	}
+	size = info.st_size;
+
+	// The mapping keeps the file alive
+	data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, file, 0);
+	::close(file);
+	if(data == MAP_FAILED)
+	{
+		data = NULL;
+	}
+#endif
+
+	return data != NULL;
+}
+
+void TileMap::unmap_file()
+{
+	if(data != NULL)
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(data);
+#else
+		munmap(data, size);
+#endif
+	}
+	data = NULL;
+	size = 0;
+}
+
+bool TileMap::load(std::string filename)
+{
+	clear();
+
+	if(map_file(filename) == false)
+	{
+		return false;
+	}
+
+	// Check the header makes sense before trusting its sizes
+	if(size < sizeof(MapHeader))
+	{
+		clear();
+		return false;
+	}
+	MapHeader header;
+	memcpy(&header, data, sizeof(header));
+
+	if(memcmp(header.magic, MAP_MAGIC, sizeof(header.magic)) != 0)
+	{
+		clear();
+		return false;
+	}
+	if((header.tileSize == 0) || (header.chunkTiles == 0) || (header.width == 0) || (header.height == 0))
+	{
+		clear();
+		return false;
+	}
+	if((header.chunksAcross != (header.width + header.chunkTiles - 1) / header.chunkTiles) || (header.chunksDown != (header.height + header.chunkTiles - 1) / header.chunkTiles))
+	{
+		clear();
+		return false;
+	}
+	if((header.tileSize > 1024) || (header.chunkTiles > 1024) || ((Uint64)header.width * header.tileSize > 0x7FFFFFFF) || ((Uint64)header.height * header.tileSize > 0x7FFFFFFF))
+	{
+		clear();
+		return false;
+	}
+	if(memchr(header.tileset, 0, sizeof(header.tileset)) == NULL)
+	{
+		clear();
+		return false;
+	}
+
+	// The chunks have to all be in the file
+	Uint64 chunkBytes = (Uint64)header.chunkTiles * header.chunkTiles * sizeof(Uint16);
+	if(header.chunkOffset + (Uint64)header.chunksAcross * header.chunksDown * chunkBytes > size)
+	{
+		clear();
+		return false;
+	}
+
+	// The tileset is next to the map
+	std::string path = filename;
+	size_t slash = path.find_last_of("/\\");
+	if(slash == std::string::npos)
+	{
+		path = "";
+	}
+	else
+	{
+		path = path.substr(0, slash + 1);
+	}
+
+	tileset = images.get(path + header.tileset);
+	if((tileset == NULL) || (tileset->w < (int)header.tileSize))
+	{
+		clear();
+		return false;
+	}
+
+	tileSize = header.tileSize;
+	chunkTiles = header.chunkTiles;
+	width = header.width;
+	height = header.height;
+	chunksAcross = header.chunksAcross;
+	chunksDown = header.chunksDown;
+	chunkOffset = header.chunkOffset;
+	tilesetColumns = tileset->w / tileSize;
+
+	// Nothing's loaded yet
+	Chunk chunk;
+	chunk.tiles = NULL;
+	chunk.wanted = -1;
+	chunks.assign(chunksAcross * chunksDown, chunk);
+
+	// Start streaming
+	lock = SDL_CreateMutex();
+	queued = SDL_CreateCond();
+	if((lock == NULL) || (queued == NULL))
+	{
+		clear();
+		return false;
+	}
+
+	stopping = false;
+	worker = SDL_CreateThread(work, this);
+	if(worker == NULL)
+	{
+		clear();
+		return false;
+	}
+
+	return true;
+}
+
+void TileMap::clear()
+{
+	// Tell the thread to finish and wait for it
+	if(worker != NULL)
+	{
+		SDL_mutexP(lock);
+		stopping = true;
+		SDL_CondBroadcast(queued);
+		SDL_mutexV(lock);
+
+		SDL_WaitThread(worker, NULL);
+		worker = NULL;
+	}
+
+	if(queued != NULL)
+	{
+		SDL_DestroyCond(queued);
+		queued = NULL;
+	}
+	if(lock != NULL)
+	{
+		SDL_DestroyMutex(lock);
+		lock = NULL;
+	}
+
+	// Free what it copied that was never taken in
+	for(unsigned int i = 0; i < done.size(); i++)
+	{
+		delete[] done[i].second;
+	}
+	done.clear();
+	pending.clear();
+	busy = -1;
+
+	// Free the loaded chunks
+	for(unsigned int i = 0; i < loaded.size(); i++)
+	{
+		delete[] chunks[loaded[i]].tiles;
+	}
+	loaded.clear();
+	chunks.clear();
+	bytes = 0;
+	streams = 0;
+	misses = 0;
+
+	unmap_file();
+
+	images.release(tileset);
+	tileset = NULL;
+
+	width = 0;
+	height = 0;
+	chunksAcross = 0;
+	chunksDown = 0;
+}
+
+int TileMap::get_width()
+{
+	return width * tileSize;
+}
+
+int TileMap::get_height()
+{
+	return height * tileSize;
+}
+
+int TileMap::get_bytes()
+{
+	return bytes;
+}
+
+int TileMap::get_misses()
+{
+	return misses;
+}
+
+Uint16 *TileMap::copy_chunk(int chunk)
+{
+	int count = chunkTiles * chunkTiles;
+
+	Uint16 *tiles = new Uint16[count];
+	memcpy(tiles, (Uint8 *)data + chunkOffset + (size_t)chunk * count * sizeof(Uint16), count * sizeof(Uint16));
+
+	return tiles;
+}
+
+void TileMap::add_chunk(int chunk, Uint16 *tiles)
+{
+	// If it was loaded another way in the meantime
+	if(chunks[chunk].tiles != NULL)
+	{
+		delete[] tiles;
+		return;
+	}
+
+	chunks[chunk].tiles = tiles;
+	loaded.push_back(chunk);
+	bytes += chunkTiles * chunkTiles * sizeof(Uint16);
+}
+
+int TileMap::distance(int chunk, Camera *camera)
+{
+	int chunkSize = chunkTiles * tileSize;
+	int dx = chunk % chunksAcross - (camera->x + camera->w / 2) / chunkSize;
+	int dy = chunk / chunksAcross - (camera->y + camera->h / 2) / chunkSize;
+
+	return dx * dx + dy * dy;
+}
+
+void TileMap::stream(Camera *camera, int xVel, int yVel)
+{
+	if(chunks.empty() == true)
+	{
+		return;
+	}
+
+	streams++;
+
+	// Take in what the thread's copied
+	SDL_mutexP(lock);
+	for(unsigned int i = 0; i < done.size(); i++)
+	{
+		add_chunk(done[i].first, done[i].second);
+	}
+	done.clear();
+	SDL_mutexV(lock);
+
+	int chunkSize = chunkTiles * tileSize;
+
+	// There's been no chance to stream in the first view, so load it now rather than count it as missed
+	if(streams == 1)
+	{
+		int viewLeft = std::max(camera->x, 0) / chunkSize;
+		int viewTop = std::max(camera->y, 0) / chunkSize;
+		int viewRight = std::min((camera->x + camera->w - 1) / chunkSize, chunksAcross - 1);
+		int viewBottom = std::min((camera->y + camera->h - 1) / chunkSize, chunksDown - 1);
+
+		for(int y = viewTop; y <= viewBottom; y++)
+		{
+			for(int x = viewLeft; x <= viewRight; x++)
+			{
+				int chunk = y * chunksAcross + x;
+				if(chunks[chunk].tiles == NULL)
+				{
+					add_chunk(chunk, copy_chunk(chunk));
+				}
+			}
+		}
+	}
+
+	// The area from the camera to where it'll be if the dot keeps going, with a margin round it
+	int aheadX = camera->x + xVel * STREAM_LOOKAHEAD;
+	int aheadY = camera->y + yVel * STREAM_LOOKAHEAD;
+
+	int left = std::max(std::min(camera->x, aheadX) / chunkSize - STREAM_MARGIN, 0);
+	int top = std::max(std::min(camera->y, aheadY) / chunkSize - STREAM_MARGIN, 0);
+	int right = std::min((std::max(camera->x, aheadX) + camera->w - 1) / chunkSize + STREAM_MARGIN, chunksAcross - 1);
+	int bottom = std::min((std::max(camera->y, aheadY) + camera->h - 1) / chunkSize + STREAM_MARGIN, chunksDown - 1);
+
+	// Ask for the ones in it that aren't loaded
+	std::vector<std::pair<int, int> > wanted;
+	for(int y = top; y <= bottom; y++)
+	{
+		for(int x = left; x <= right; x++)
+		{
+			int chunk = y * chunksAcross + x;
+			chunks[chunk].wanted = streams;
+
+			if(chunks[chunk].tiles == NULL)
+			{
+				wanted.push_back(std::make_pair(-distance(chunk, camera), chunk));
+			}
+		}
+	}
+
+	// The thread takes from the back, so the nearest go last
+	std::sort(wanted.begin(), wanted.end());
+
+	SDL_mutexP(lock);
+	pending.clear();
+	for(unsigned int i = 0; i < wanted.size(); i++)
+	{
+		if(wanted[i].second != busy)
+		{
+			pending.push_back(wanted[i].second);
+		}
+	}
+	SDL_CondSignal(queued);
+	SDL_mutexV(lock);
+
+	// Over the budget, unload the farthest chunks that aren't wanted
+	if(bytes > STREAM_BUDGET)
+	{
+		std::vector<std::pair<int, int> > unwanted;
+		for(unsigned int i = 0; i < loaded.size(); i++)
+		{
+			if(chunks[loaded[i]].wanted != streams)
+			{
+				unwanted.push_back(std::make_pair(distance(loaded[i], camera), loaded[i]));
+			}
+		}
+		std::sort(unwanted.begin(), unwanted.end());
+
+		while((bytes > STREAM_BUDGET) && (unwanted.empty() == false))
+		{
+			int chunk = unwanted.back().second;
+			unwanted.pop_back();
+
+			delete[] chunks[chunk].tiles;
+			chunks[chunk].tiles = NULL;
+			loaded.erase(std::find(loaded.begin(), loaded.end(), chunk));
+			bytes -= chunkTiles * chunkTiles * sizeof(Uint16);
+		}
+	}
+}
+
+void TileMap::draw(Camera *camera, SDL_Surface *destination)
+{
+	if(chunks.empty() == true)
+	{
+		return;
+	}
+
+	// The chunks the camera is over
+	int chunkSize = chunkTiles * tileSize;
+	int left = std::max(camera->x, 0) / chunkSize;
+	int top = std::max(camera->y, 0) / chunkSize;
+	int right = std::min((camera->x + camera->w - 1) / chunkSize, chunksAcross - 1);
+	int bottom = std::min((camera->y + camera->h - 1) / chunkSize, chunksDown - 1);
+
+	for(int chunkY = top; chunkY <= bottom; chunkY++)
+	{
+		for(int chunkX = left; chunkX <= right; chunkX++)
+		{
+			draw_chunk(chunkX, chunkY, camera, destination);
+		}
+	}
+}
+
+void TileMap::draw_chunk(int chunkX, int chunkY, Camera *camera, SDL_Surface *destination)
+{
+	int number = chunkY * chunksAcross + chunkX;
+
+	// If it wasn't streamed in in time, load it now
+	if(chunks[number].tiles == NULL)
+	{
+		add_chunk(number, copy_chunk(number));
+		misses++;
+	}
+	const Uint16 *chunk = chunks[number].tiles;
+
+	// The tiles of the chunk the camera is over
+	int left = std::max(chunkX * chunkTiles, std::max(camera->x, 0) / tileSize);
+	int top = std::max(chunkY * chunkTiles, std::max(camera->y, 0) / tileSize);
+	int right = std::min((chunkX + 1) * chunkTiles, (camera->x + camera->w - 1) / tileSize + 1);
+	int bottom = std::min((chunkY + 1) * chunkTiles, (camera->y + camera->h - 1) / tileSize + 1);
+
+	SDL_Rect clip;
+	clip.w = tileSize;
+	clip.h = tileSize;
+
+	for(int y = top; y < bottom; y++)
+	{
+		const Uint16 *row = chunk + (y - chunkY * chunkTiles) * chunkTiles - chunkX * chunkTiles;
+
+		for(int x = left; x < right; x++)
+		{
+			// Nothing to draw for an empty tile
+			if(row[x] == MAP_EMPTY)
+			{
+				continue;
+			}
+
+			clip.x = (row[x] % tilesetColumns) * tileSize;
+			clip.y = (row[x] / tilesetColumns) * tileSize;
+
+			apply_surface(x * tileSize - camera->x, y * tileSize - camera->y, tileset, destination, &clip);
+		}
+	}
+}
+
+int TileMap::work(void *data)
+{
+	TileMap *map = (TileMap *)data;
+
+	SDL_mutexP(map->lock);
+	while(true)
+	{
+		// Sleep until there's a chunk to copy or it's time to stop
+		while((map->pending.empty() == true) && (map->stopping == false))
+		{
+			SDL_CondWait(map->queued, map->lock);
+		}
+
+		if(map->stopping == true)
+		{
+			break;
+		}
+
+		// Take the nearest chunk
+		int chunk = map->pending.back();
+		map->pending.pop_back();
+		map->busy = chunk;
+		SDL_mutexV(map->lock);
+
+		// Copy it without holding the lock, touching the file's pages here rather than while drawing
+		Uint16 *tiles = map->copy_chunk(chunk);
+
+		// Hand it back for the next stream to take in
+		SDL_mutexP(map->lock);
+		map->done.push_back(std::make_pair(chunk, tiles));
+		map->busy = -1;
+	}
+	SDL_mutexV(map->lock);
+
+	return 0;
+}
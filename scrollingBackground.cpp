@@ -2,7 +2,16 @@
 #include "SDL/SDL.h"
 #include "SDL/SDL_image.h"
 #include <string>
+#include <chrono>
+#include <thread>
 #include <iostream> 
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <cmath>
 
 // The screen attributes
 const int SCREEN_WIDTH = 640;
@@ -13,6 +22,14 @@ const int SCREEN_BPP = 32;
 const int DOT_WIDTH = 20;
 const int DOT_HEIGHT = 20;
 
+// A position or speed with 16 bits of it after the point, so things can move by fractions of a pixel without floating point
+typedef Sint64 Fixed;
+const int FIXED_SHIFT = 16;
+const Fixed FIXED_ONE = (Fixed)1 << FIXED_SHIFT;
+
+// How fast the dot moves in a frame
+const Fixed DOT_SPEED = FIXED_ONE * DOT_WIDTH / 2;
+
 // The dimensions of the level
 const int LEVEL_WIDTH = 1280;
 const int LEVEL_HEIGHT = 960;
@@ -20,6 +37,18 @@ const int LEVEL_HEIGHT = 960;
 // The frame rate
 const int FRAMES_PER_SECOND = 20;
 
+// How far the background scrolls in a frame, it can be a fraction of a pixel
+const Fixed SCROLL_SPEED = FIXED_ONE * 2;
+
+// How long before a deadline the frame pacer stops sleeping and spins, in milliseconds
+const double PACER_SPIN_TIME = 2.0;
+
+// Which ways a parallax layer repeats
+const int WRAP_NONE = 0;
+const int WRAP_X = 1;
+const int WRAP_Y = 2;
+const int WRAP_BOTH = WRAP_X | WRAP_Y;
+
 // The surfaces
 SDL_Surface *dot = NULL;
 SDL_Surface *background = NULL;
@@ -50,10 +79,10 @@ class Dot
 		
 	private:
 		// The x and y offsets of the dot
-		int x, y;
+		Fixed x, y;
 
 		// The velocity of the dot
-		int xVel, yVel;
+		Fixed xVel, yVel;
 };
 
 // The timer
@@ -66,36 +95,179 @@ class Timer
 		void pause();
 		void unpause();
 
-		int get_ticks();
+		double get_ticks();
+		std::chrono::nanoseconds get_time();
 
 		bool is_started();
 		bool is_paused();
 
 	private:
-		int startTicks;
-		int pausedTicks;
+		std::chrono::steady_clock::time_point startTime;
+		std::chrono::nanoseconds pausedTime;
 
 		bool paused;
 		bool started;
 };
 
+// Holds frames to a fixed rate against a running deadline
+class FramePacer
+{
+	public:
+		// Sets the frame rate to pace to
+		FramePacer(int framesPerSecond);
+
+		// Sets the first deadline one frame from now
+		void start();
+
+		// Waits for the current deadline and moves it on by one frame
+		void wait();
+
+		// Gets the number of deadlines that had already passed when waited on
+		int get_missed();
+
+	private:
+		// The time since pacing started
+		Timer clock;
+
+		// The length of a frame in milliseconds
+		double frameLength;
+
+		// When the current frame should end
+		double deadline;
+
+		// The number of missed deadlines
+		int missed;
+};
+
+// A screen sized buffer of the background that wraps round, scrolling moves where the view starts in it
+// and only what comes into view is drawn, the rest is kept from earlier frames
+class ScrollBuffer
+{
+	public:
+		// Initializes the variables
+		ScrollBuffer();
+
+		// Makes a buffer in the screen's format and draws the whole view into it
+		bool open(SDL_Surface *screen, SDL_Surface *background);
+
+		// Frees the buffer
+		void close();
+
+		// Moves the view over the background by the distances and draws in what's come into view
+		void scroll(int dx, int dy);
+
+		// Copies the view to the top left of the destination
+		void show(SDL_Surface *destination);
+
+	private:
+		// The buffer and what's drawn into it
+		SDL_Surface *buffer;
+		SDL_Surface *background;
+
+		// Where the view's top left is on the background, kept within its size
+		int viewX, viewY;
+
+		// Where the view's top left is in the buffer
+		int originX, originY;
+
+		// Draws the background into an area of the view, given relative to the view's top left
+		void draw_area(int x, int y, int w, int h);
+
+		// Draws the background into an area of the buffer that doesn't wrap, from the spot on the background
+		void draw_piece(SDL_Rect area, int fromX, int fromY);
+};
+
+// Background layers each scrolled at their own fraction of the camera's speed, drawn back to front
+// Parts of a layer that are covered by solid parts of nearer layers aren't drawn
+class Parallax
+{
+	public:
+		// Loads layers back to front from a file of "image x y speedX speedY none|x|y|both opaque|transparent" lines
+		// Says on stderr what's wrong with a file that's there but doesn't make sense
+		bool load(std::string filename);
+
+		// Adds a layer in front of the others, the parallax frees the image
+		// An opaque layer has no see through pixels, a transparent one is searched for rows that are solid all the way across
+		void add_layer(SDL_Surface *image, int x, int y, double speedX, double speedY, int wrap, bool opaque);
+
+		// Frees the layers
+		void clear();
+
+		// Gets the number of layers
+		int get_count();
+
+		// Draws the layers over the whole destination for the camera's position, each snapped to the pixel
+		void draw(Fixed cameraX, Fixed cameraY, SDL_Surface *destination);
+
+	private:
+		// A layer
+		struct Layer
+		{
+			SDL_Surface *image;
+
+			// Where it is with the camera at the start, and how much of the camera's movement it follows
+			int x, y;
+			Fixed speedX, speedY;
+
+			// The ways it repeats
+			int wrap;
+
+			// The part of the image with nothing see through in it, nothing if w is 0
+			SDL_Rect solid;
+		};
+
+		// The layers, back to front
+		std::vector<Layer> layers;
+
+		// Finds the longest run of rows with no color keyed pixels
+		static SDL_Rect find_solid(SDL_Surface *image);
+
+		// Gets the screen areas covered by copies of a part of a layer inside the area, and where in the image each comes from
+		static void place(const Layer &layer, SDL_Rect part, int originX, int originY, SDL_Rect area, std::vector<SDL_Rect> &placed, std::vector<SDL_Rect> &sources);
+
+		// Cuts a rectangle out of each of a list of them
+		static void subtract(std::vector<SDL_Rect> &areas, SDL_Rect cut);
+};
 
 // Function Prototypes
 bool init();
 SDL_Surface *load_image(std::string file);
 void apply_surface(int x, int y, SDL_Surface *source, SDL_Surface *destination, SDL_Rect *clip = NULL);
+Fixed to_fixed(int pixels);
+int to_pixels(Fixed value);
+Fixed fixed_multiply(Fixed a, Fixed b);
 bool load_files();
 void clean_up();
 
-int main()
+int main(int argc, char *args[])
 {
 	// Quit flag
 	bool quit = false;
 	int bgX = 0, bgY = 0;
 
+	// How far the background has scrolled, and the whole pixels of it last shown
+	Fixed scrollX = 0;
+	int shownX = 0;
+
+	// Draw the whole background every frame rather than keep a scroll buffer if asked
+	bool redraw = false;
+	for(int i = 1; i < argc; i++)
+	{
+		if(strcmp(args[i], "-redraw") == 0)
+		{
+			redraw = true;
+		}
+	}
+
+	// The background as last drawn
+	ScrollBuffer view;
+
+	// The background layers if there are any
+	Parallax layers;
+
 	// Class instances
 	Dot myDot;
-	Timer fps;
+	FramePacer fps(FRAMES_PER_SECOND);
 	
 	if(init() == false)
 	{
@@ -107,12 +279,28 @@ int main()
 		return 1;
 	}
 
+	// Use the parallax layers if there's a list of them, a list that's there but broken is an error
+	std::ifstream layerList("layers.txt");
+	if(layerList.is_open() == true)
+	{
+		layerList.close();
+		if(layers.load("layers.txt") == false)
+		{
+			return 1;
+		}
+	}
+
+	if((layers.get_count() == 0) && (redraw == false) && (view.open(screen, background) == false))
+	{
+		return 1;
+	}
+
+	// Start pacing frames
+	fps.start();
+
 	// While the user has not quit
 	while(quit == false)
 	{
-		// Start the timer
-		fps.start();
-
 		// While the there's events to handle
 		while(SDL_PollEvent(&event))
 		{
@@ -124,18 +312,31 @@ int main()
 			}
 		}
 
-		// Scroll the background
-		bgX -= 2;
+		// Scroll the background, it's only snapped to the pixel when it's drawn
+		scrollX += SCROLL_SPEED;
+		int pixels = to_pixels(scrollX);
 
-		// Reset the screen once at the end
-		if(bgX <= -background->w)
+		// Show the background
+		if(layers.get_count() > 0)
 		{
-			bgX = 0;
+			// The camera moves as the single background did, each layer follows it at its own speed
+			layers.draw(scrollX, 0, screen);
 		}
+		else if(redraw == true)
+		{
+			// Start over once a whole background has gone by
+			bgX = -(pixels % background->w);
 
-		// Show the background
-		apply_surface(bgX, bgY, background, screen);
-		apply_surface(bgX + background->w, bgY, background, screen);
+			apply_surface(bgX, bgY, background, screen);
+			apply_surface(bgX + background->w, bgY, background, screen);
+		}
+		else
+		{
+			// Only the strip scrolled into view is drawn
+			view.scroll(pixels - shownX, 0);
+			view.show(screen);
+		}
+		shownX = pixels;
 
 		// Show the dot
 		apply_surface(310, 230, dot, screen);
@@ -147,12 +348,11 @@ int main()
 		}
 
 		// Cap the frame rate
-		if(fps.get_ticks() < 1000 / FRAMES_PER_SECOND)
-		{
-			SDL_Delay((1000 / FRAMES_PER_SECOND) - fps.get_ticks());
-		}
+		fps.wait();
 	}
 
+	layers.clear();
+	view.close();
 	clean_up();
 	return 0;
 }
@@ -203,6 +403,32 @@ void apply_surface(int x, int y, SDL_Surface *source, SDL_Surface *destination,
 
 	SDL_BlitSurface(source, clip, destination, &offset);
 }
+
+Fixed to_fixed(int pixels)
+{
+	return (Fixed)pixels * FIXED_ONE;
+}
+
+int to_pixels(Fixed value)
+{
+	// Round down, to the pixel the value is in
+	if(value < 0)
+	{
+		return -(int)((-value + FIXED_ONE - 1) / FIXED_ONE);
+	}
+	return (int)(value / FIXED_ONE);
+}
+
+Fixed fixed_multiply(Fixed a, Fixed b)
+{
+	// Round down like to_pixels does, so a layer doesn't jump a pixel as the camera crosses 0
+	Fixed product = a * b;
+	if(product < 0)
+	{
+		return -((-product + FIXED_ONE - 1) >> FIXED_SHIFT);
+	}
+	return product >> FIXED_SHIFT;
+}
 	
 bool load_files()
 {
@@ -242,20 +468,20 @@ void Dot::handle_input()
 	{
 		switch(event.key.keysym.sym)
 		{
-			case SDLK_UP: yVel -= DOT_HEIGHT / 2; break;
-			case SDLK_DOWN: yVel += DOT_HEIGHT / 2; break;
-			case SDLK_LEFT: xVel -= DOT_WIDTH / 2; break;
-			case SDLK_RIGHT: xVel += DOT_WIDTH / 2; break;
+			case SDLK_UP: yVel -= DOT_SPEED; break;
+			case SDLK_DOWN: yVel += DOT_SPEED; break;
+			case SDLK_LEFT: xVel -= DOT_SPEED; break;
+			case SDLK_RIGHT: xVel += DOT_SPEED; break;
 		}
 	}
 	if(event.type == SDL_KEYUP)
 	{
 		switch(event.key.keysym.sym)
 		{
-			case SDLK_UP: yVel += DOT_HEIGHT / 2; break;
-			case SDLK_DOWN: yVel -= DOT_HEIGHT / 2; break;
-			case SDLK_LEFT: xVel += DOT_WIDTH / 2; break;
-			case SDLK_RIGHT: xVel -= DOT_WIDTH / 2; break;
+			case SDLK_UP: yVel += DOT_SPEED; break;
+			case SDLK_DOWN: yVel -= DOT_SPEED; break;
+			case SDLK_LEFT: xVel += DOT_SPEED; break;
+			case SDLK_RIGHT: xVel -= DOT_SPEED; break;
 		}
 	}
 }
@@ -266,7 +492,7 @@ void Dot::move()
 	x += xVel;
 
 	// if the dot went too far to the left or right
-	if((x < 0) || (x + DOT_WIDTH > LEVEL_WIDTH))
+	if((x < 0) || (x + to_fixed(DOT_WIDTH) > to_fixed(LEVEL_WIDTH)))
 	{
 		// Move back!
 		x -= xVel;
@@ -276,7 +502,7 @@ void Dot::move()
 	y += yVel;
 
 	// If the dot went too far up or down
-	if((y < 0) || (y + DOT_HEIGHT > LEVEL_HEIGHT))
+	if((y < 0) || (y + to_fixed(DOT_HEIGHT) > to_fixed(LEVEL_HEIGHT)))
 	{
 		// Move back!
 		y -= yVel;
@@ -317,8 +543,8 @@ void Dot::show()
 
 Timer::Timer()
 {
-	startTicks = 0;
-	pausedTicks = 0;
+	startTime = std::chrono::steady_clock::time_point();
+	pausedTime = std::chrono::nanoseconds::zero();
 	started = false;
 	paused = false;
 }
@@ -329,7 +555,7 @@ void Timer::start()
 
 	paused = false;
 
-	startTicks = SDL_GetTicks();
+	startTime = std::chrono::steady_clock::now();
 }
 
 void Timer::stop()
@@ -343,7 +569,7 @@ void Timer::pause()
 	if((started == true) && (paused == false))
 	{
 		paused = true;
-		pausedTicks = SDL_GetTicks() - startTicks;
+		pausedTime = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime);
 	}
 }
 
@@ -352,28 +578,33 @@ void Timer::unpause()
 	if(paused == true)
 	{
 		paused = false;
-		startTicks = SDL_GetTicks() - pausedTicks;
+		startTime = std::chrono::steady_clock::now() - pausedTime;
 
-		pausedTicks = 0;
+		pausedTime = std::chrono::nanoseconds::zero();
 	}
 }
 
-int Timer::get_ticks()
+std::chrono::nanoseconds Timer::get_time()
 {
 	if(started == true)
 	{
 		if(paused == true)
 		{
-			return pausedTicks;
+			return pausedTime;
 		}
 
 		else
 		{
-			return SDL_GetTicks() - startTicks;
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime);
 		}
 	}
 
-	return 0;
+	return std::chrono::nanoseconds::zero();
+}
+
+double Timer::get_ticks()
+{
+	return std::chrono::duration<double, std::milli>(get_time()).count();
 }
 
 bool Timer::is_started()
@@ -385,3 +616,569 @@ bool Timer::is_paused()
 {
 	return paused;
 }
+
+FramePacer::FramePacer(int framesPerSecond)
+{
+	// Initialize the variables
+	frameLength = 1000.0 / framesPerSecond;
+	deadline = 0;
+	missed = 0;
+}
+
+void FramePacer::start()
+{
+	// Start the clock with the first frame due one frame from now
+	clock.start();
+	deadline = frameLength;
+}
+
+void FramePacer::wait()
+{
+	double now = clock.get_ticks();
+
+	// If the frame ran past its deadline
+	if(now > deadline)
+	{
+		missed++;
+
+		// If it's a whole frame behind, start over from now instead of rushing to catch up
+		if(now - deadline >= frameLength)
+		{
+			deadline = now;
+		}
+	}
+	else
+	{
+		// Sleep through most of the wait, the OS may wake us late
+		if(deadline - now > PACER_SPIN_TIME)
+		{
+			SDL_Delay((Uint32)(deadline - now - PACER_SPIN_TIME));
+		}
+
+		// Spin out the rest against the clock
+		while(clock.get_ticks() < deadline)
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	// The next deadline is one frame after this one, so lateness doesn't add up
+	deadline += frameLength;
+}
+
+int FramePacer::get_missed()
+{
+	return missed;
+}
+
+ScrollBuffer::ScrollBuffer()
+{
+	buffer = NULL;
+	background = NULL;
+	viewX = 0;
+	viewY = 0;
+	originX = 0;
+	originY = 0;
+}
+
+bool ScrollBuffer::open(SDL_Surface *screen, SDL_Surface *background)
+{
+	close();
+
+	SDL_PixelFormat *format = screen->format;
+	buffer = SDL_CreateRGBSurface(SDL_SWSURFACE, screen->w, screen->h, format->BitsPerPixel, format->Rmask, format->Gmask, format->Bmask, format->Amask);
+	if(buffer == NULL)
+	{
+		return false;
+	}
+
+	this->background = background;
+	viewX = 0;
+	viewY = 0;
+	originX = 0;
+	originY = 0;
+
+	// Draw the first view whole
+	draw_area(0, 0, buffer->w, buffer->h);
+
+	return true;
+}
+
+void ScrollBuffer::close()
+{
+	SDL_FreeSurface(buffer);
+	buffer = NULL;
+	background = NULL;
+}
+
+void ScrollBuffer::scroll(int dx, int dy)
+{
+	int w = buffer->w;
+	int h = buffer->h;
+
+	// Move the view over the background and in the buffer, wrapping each round
+	viewX = ((viewX + dx) % background->w + background->w) % background->w;
+	viewY = ((viewY + dy) % background->h + background->h) % background->h;
+	originX = ((originX + dx) % w + w) % w;
+	originY = ((originY + dy) % h + h) % h;
+
+	// If it moved a whole view there's nothing to keep
+	if((abs(dx) >= w) || (abs(dy) >= h))
+	{
+		draw_area(0, 0, w, h);
+		return;
+	}
+
+	// Draw the columns that came in at the side it moved toward
+	if(dx > 0)
+	{
+		draw_area(w - dx, 0, dx, h);
+	}
+	else if(dx < 0)
+	{
+		draw_area(0, 0, -dx, h);
+	}
+
+	// Then the rows
+	if(dy > 0)
+	{
+		draw_area(0, h - dy, w, dy);
+	}
+	else if(dy < 0)
+	{
+		draw_area(0, 0, w, -dy);
+	}
+}
+
+void ScrollBuffer::draw_area(int x, int y, int w, int h)
+{
+	// Where the area starts in the buffer
+	int left = (originX + x) % buffer->w;
+	int top = (originY + y) % buffer->h;
+
+	// How much fits before the buffer wraps round
+	int firstW = std::min(w, buffer->w - left);
+	int firstH = std::min(h, buffer->h - top);
+
+	// Draw it in up to four pieces, one each side of where the buffer wraps
+	for(int i = 0; i < 2; i++)
+	{
+		for(int j = 0; j < 2; j++)
+		{
+			SDL_Rect area;
+			area.x = (i == 0) ? left : 0;
+			area.y = (j == 0) ? top : 0;
+			area.w = (i == 0) ? firstW : w - firstW;
+			area.h = (j == 0) ? firstH : h - firstH;
+
+			if((area.w > 0) && (area.h > 0))
+			{
+				draw_piece(area, viewX + x + ((i == 0) ? 0 : firstW), viewY + y + ((j == 0) ? 0 : firstH));
+			}
+		}
+	}
+}
+
+void ScrollBuffer::draw_piece(SDL_Rect area, int fromX, int fromY)
+{
+	// Keep the blits inside the piece
+	SDL_SetClipRect(buffer, &area);
+
+	// What the background doesn't cover shows black
+	SDL_FillRect(buffer, &area, SDL_MapRGB(buffer->format, 0, 0, 0));
+
+	// The background repeats, start from the copy the spot is in
+	int startX = area.x - fromX % background->w;
+	int startY = area.y - fromY % background->h;
+
+	for(int y = startY; y < area.y + area.h; y += background->h)
+	{
+		for(int x = startX; x < area.x + area.w; x += background->w)
+		{
+			apply_surface(x, y, background, buffer);
+		}
+	}
+
+	SDL_SetClipRect(buffer, NULL);
+}
+
+void ScrollBuffer::show(SDL_Surface *destination)
+{
+	int w = buffer->w;
+	int h = buffer->h;
+
+	// The buffer's four quarters either side of the view's top left go to the opposite corners
+	for(int i = 0; i < 2; i++)
+	{
+		for(int j = 0; j < 2; j++)
+		{
+			SDL_Rect from;
+			from.x = (i == 0) ? originX : 0;
+			from.y = (j == 0) ? originY : 0;
+			from.w = (i == 0) ? w - originX : originX;
+			from.h = (j == 0) ? h - originY : originY;
+
+			if((from.w > 0) && (from.h > 0))
+			{
+				apply_surface((i == 0) ? 0 : w - originX, (j == 0) ? 0 : h - originY, buffer, destination, &from);
+			}
+		}
+	}
+}
+
+bool Parallax::load(std::string filename)
+{
+	clear();
+
+	std::ifstream file(filename.c_str());
+	if(file.fail() == true)
+	{
+		return false;
+	}
+
+	std::string line;
+	int lineNumber = 0;
+	while(std::getline(file, line))
+	{
+		lineNumber++;
+
+		// Skip blank lines and comments
+		if((line.empty() == true) || (line[0] == '#'))
+		{
+			continue;
+		}
+
+		std::stringstream fields(line);
+		std::string name, wrapName, hint, extra;
+		int x, y;
+		double speedX, speedY;
+
+		if((!(fields >> name >> x >> y >> speedX >> speedY >> wrapName >> hint)) || (fields >> extra))
+		{
+			std::cerr << filename << ":" << lineNumber << ": expected \"image x y speedX speedY none|x|y|both opaque|transparent\"" << std::endl;
+			clear();
+			return false;
+		}
+
+		int wrap;
+		if(wrapName == "none")
+		{
+			wrap = WRAP_NONE;
+		}
+		else if(wrapName == "x")
+		{
+			wrap = WRAP_X;
+		}
+		else if(wrapName == "y")
+		{
+			wrap = WRAP_Y;
+		}
+		else if(wrapName == "both")
+		{
+			wrap = WRAP_BOTH;
+		}
+		else
+		{
+			std::cerr << filename << ":" << lineNumber << ": unknown wrap \"" << wrapName << "\"" << std::endl;
+			clear();
+			return false;
+		}
+
+		if((hint != "opaque") && (hint != "transparent"))
+		{
+			std::cerr << filename << ":" << lineNumber << ": unknown hint \"" << hint << "\"" << std::endl;
+			clear();
+			return false;
+		}
+
+		SDL_Surface *image = load_image(name);
+		if(image == NULL)
+		{
+			std::cerr << filename << ":" << lineNumber << ": couldn't load " << name << std::endl;
+			clear();
+			return false;
+		}
+
+		add_layer(image, x, y, speedX, speedY, wrap, hint == "opaque");
+	}
+
+	if(layers.empty() == true)
+	{
+		std::cerr << filename << ": no layers" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+void Parallax::add_layer(SDL_Surface *image, int x, int y, double speedX, double speedY, int wrap, bool opaque)
+{
+	Layer layer;
+	layer.image = image;
+	layer.x = x;
+	layer.y = y;
+	// The speeds are only read in as decimals, drawing follows the camera in fixed point
+	layer.speedX = (Fixed)floor(speedX * FIXED_ONE + 0.5);
+	layer.speedY = (Fixed)floor(speedY * FIXED_ONE + 0.5);
+	layer.wrap = wrap;
+
+	// Take an opaque layer's word for it, search a transparent one
+	if(opaque == true)
+	{
+		layer.solid.x = 0;
+		layer.solid.y = 0;
+		layer.solid.w = image->w;
+		layer.solid.h = image->h;
+	}
+	else
+	{
+		layer.solid = find_solid(image);
+	}
+
+	layers.push_back(layer);
+}
+
+void Parallax::clear()
+{
+	for(unsigned int i = 0; i < layers.size(); i++)
+	{
+		SDL_FreeSurface(layers[i].image);
+	}
+	layers.clear();
+}
+
+int Parallax::get_count()
+{
+	return layers.size();
+}
+
+SDL_Rect Parallax::find_solid(SDL_Surface *image)
+{
+	SDL_Rect solid = {0, 0, 0, 0};
+
+	// Without a color key every pixel shows
+	if((image->flags & SDL_SRCCOLORKEY) == 0)
+	{
+		solid.w = image->w;
+		solid.h = image->h;
+		return solid;
+	}
+
+	Uint32 key = image->format->colorkey;
+	int bytes = image->format->BytesPerPixel;
+
+	if(SDL_MUSTLOCK(image))
+	{
+		SDL_LockSurface(image);
+	}
+
+	int run = 0;
+	for(int y = 0; y < image->h; y++)
+	{
+		Uint8 *row = (Uint8 *)image->pixels + y * image->pitch;
+
+		// Check the row for keyed pixels
+		bool keyed = false;
+		for(int x = 0; (x < image->w) && (keyed == false); x++)
+		{
+			Uint8 *p = row + x * bytes;
+			Uint32 pixel;
+
+			switch(bytes)
+			{
+				case 1: pixel = *p; break;
+				case 2: pixel = *(Uint16 *)p; break;
+				case 3:
+					if(SDL_BYTEORDER == SDL_BIG_ENDIAN)
+					{
+						pixel = (p[0] << 16) | (p[1] << 8) | p[2];
+					}
+					else
+					{
+						pixel = p[0] | (p[1] << 8) | (p[2] << 16);
+					}
+					break;
+				default: pixel = *(Uint32 *)p; break;
+			}
+
+			keyed = (pixel == key);
+		}
+
+		// Keep the longest run of solid rows
+		if(keyed == true)
+		{
+			run = 0;
+		}
+		else
+		{
+			run++;
+			if(run > solid.h)
+			{
+				solid.y = y - run + 1;
+				solid.h = run;
+			}
+		}
+	}
+
+	if(SDL_MUSTLOCK(image))
+	{
+		SDL_UnlockSurface(image);
+	}
+
+	if(solid.h > 0)
+	{
+		solid.w = image->w;
+	}
+	return solid;
+}
+
+void Parallax::place(const Layer &layer, SDL_Rect part, int originX, int originY, SDL_Rect area, std::vector<SDL_Rect> &placed, std::vector<SDL_Rect> &sources)
+{
+	int w = layer.image->w;
+	int h = layer.image->h;
+
+	// The copies to go through, every one over the area if the layer repeats, otherwise just the one
+	int startX = originX;
+	int endX = originX + 1;
+	if((layer.wrap & WRAP_X) != 0)
+	{
+		startX = area.x - ((area.x - originX) % w + w) % w;
+		endX = area.x + area.w;
+	}
+
+	int startY = originY;
+	int endY = originY + 1;
+	if((layer.wrap & WRAP_Y) != 0)
+	{
+		startY = area.y - ((area.y - originY) % h + h) % h;
+		endY = area.y + area.h;
+	}
+
+	for(int y = startY; y < endY; y += h)
+	{
+		for(int x = startX; x < endX; x += w)
+		{
+			// Where the part of this copy lands, kept inside the area
+			int left = std::max(x + part.x, (int)area.x);
+			int top = std::max(y + part.y, (int)area.y);
+			int right = std::min(x + part.x + part.w, area.x + area.w);
+			int bottom = std::min(y + part.y + part.h, area.y + area.h);
+
+			if((right > left) && (bottom > top))
+			{
+				SDL_Rect copy;
+				copy.x = left;
+				copy.y = top;
+				copy.w = right - left;
+				copy.h = bottom - top;
+				placed.push_back(copy);
+
+				SDL_Rect source = copy;
+				source.x = left - x;
+				source.y = top - y;
+				sources.push_back(source);
+			}
+		}
+	}
+}
+
+void Parallax::subtract(std::vector<SDL_Rect> &areas, SDL_Rect cut)
+{
+	std::vector<SDL_Rect> left;
+
+	for(unsigned int i = 0; i < areas.size(); i++)
+	{
+		SDL_Rect a = areas[i];
+
+		// If they don't overlap keep it whole
+		if((cut.x >= a.x + a.w) || (cut.x + cut.w <= a.x) || (cut.y >= a.y + a.h) || (cut.y + cut.h <= a.y))
+		{
+			left.push_back(a);
+			continue;
+		}
+
+		// Keep the bands above and below the cut, then what's either side of it between them
+		int top = std::max(a.y, cut.y);
+		int bottom = std::min(a.y + a.h, cut.y + cut.h);
+
+		if(cut.y > a.y)
+		{
+			SDL_Rect above = {a.x, a.y, a.w, (Uint16)(cut.y - a.y)};
+			left.push_back(above);
+		}
+		if(cut.y + cut.h < a.y + a.h)
+		{
+			SDL_Rect below = {a.x, (Sint16)bottom, a.w, (Uint16)(a.y + a.h - bottom)};
+			left.push_back(below);
+		}
+		if(cut.x > a.x)
+		{
+			SDL_Rect before = {a.x, (Sint16)top, (Uint16)(cut.x - a.x), (Uint16)(bottom - top)};
+			left.push_back(before);
+		}
+		if(cut.x + cut.w < a.x + a.w)
+		{
+			SDL_Rect after = {(Sint16)(cut.x + cut.w), (Sint16)top, (Uint16)(a.x + a.w - cut.x - cut.w), (Uint16)(bottom - top)};
+			left.push_back(after);
+		}
+	}
+
+	areas.swap(left);
+}
+
+void Parallax::draw(Fixed cameraX, Fixed cameraY, SDL_Surface *destination)
+{
+	SDL_Rect screenArea = {0, 0, (Uint16)destination->w, (Uint16)destination->h};
+
+	// Where each layer's first copy lands for the camera
+	std::vector<int> originX(layers.size());
+	std::vector<int> originY(layers.size());
+	for(unsigned int i = 0; i < layers.size(); i++)
+	{
+		originX[i] = layers[i].x - to_pixels(fixed_multiply(cameraX, layers[i].speedX));
+		originY[i] = layers[i].y - to_pixels(fixed_multiply(cameraY, layers[i].speedY));
+	}
+
+	// Going front to back, each layer can show wherever nearer solid parts haven't covered
+	std::vector<std::vector<SDL_Rect> > showing(layers.size());
+	std::vector<SDL_Rect> uncovered(1, screenArea);
+
+	for(int i = layers.size() - 1; (i >= 0) && (uncovered.empty() == false); i--)
+	{
+		showing[i] = uncovered;
+
+		if(layers[i].solid.w > 0)
+		{
+			std::vector<SDL_Rect> covered, sources;
+			place(layers[i], layers[i].solid, originX[i], originY[i], screenArea, covered, sources);
+
+			for(unsigned int c = 0; c < covered.size(); c++)
+			{
+				subtract(uncovered, covered[c]);
+			}
+		}
+	}
+
+	// What no layer covers shows black
+	for(unsigned int u = 0; u < uncovered.size(); u++)
+	{
+		SDL_FillRect(destination, &uncovered[u], SDL_MapRGB(destination->format, 0, 0, 0));
+	}
+
+	// Draw back to front, each layer only where it shows
+	for(unsigned int i = 0; i < layers.size(); i++)
+	{
+		SDL_Rect whole = {0, 0, (Uint16)layers[i].image->w, (Uint16)layers[i].image->h};
+
+		for(unsigned int a = 0; a < showing[i].size(); a++)
+		{
+			std::vector<SDL_Rect> copies, sources;
+			place(layers[i], whole, originX[i], originY[i], showing[i][a], copies, sources);
+
+			for(unsigned int c = 0; c < copies.size(); c++)
+			{
+				apply_surface(copies[c].x, copies[c].y, layers[i].image, destination, &sources[c]);
+			}
+		}
+	}
+}
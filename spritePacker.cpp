@@ -0,0 +1,172 @@
+/* Sprite packer.
+   Converts an image to the 32 bit format SDL_DisplayFormat gives a 32 bpp screen and writes it out raw,
+   with the color key and the sheet's clips baked in, so a sample can map the file and blit from it directly.
+
+   spritePacker input.png output.spr [x,y,w,h ...]
+*/
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include "SDL.h"
+#include "SDL_image.h"
+
+// The pixel format packed sprites are stored in
+const int SPRITE_BPP = 32;
+const Uint32 SPRITE_RMASK = 0x00FF0000;
+const Uint32 SPRITE_GMASK = 0x0000FF00;
+const Uint32 SPRITE_BMASK = 0x000000FF;
+
+// The pixels start on a multiple of this many bytes
+const Uint32 SPRITE_ALIGN = 64;
+
+// The first bytes of a packed sprite file
+const char SPRITE_MAGIC[4] = {'S', 'P', 'R', '1'};
+
+// The header at the start of a packed sprite file, followed by the clips as four Sint32s each, then the pixels
+struct SpriteHeader
+{
+	// SPRITE_MAGIC
+	char magic[4];
+
+	// The dimensions of the image
+	Uint32 w, h;
+
+	// The bytes in each row of pixels
+	Uint32 pitch;
+
+	// The pixel format
+	Uint32 bpp;
+	Uint32 rMask, gMask, bMask, aMask;
+
+	// The color key as a pixel value
+	Uint32 colorKey;
+
+	// The number of clips
+	Uint32 clipCount;
+
+	// Where the pixels start in the file
+	Uint32 pixelOffset;
+};
+
+int main(int argc, char *args[])
+{
+	if(argc < 3)
+	{
+		std::cerr << "Usage: spritePacker input.png output.spr [x,y,w,h ...]" << std::endl;
+		return 1;
+	}
+
+	// Read the clips
+	std::vector<Sint32> clips;
+	for(int i = 3; i < argc; i++)
+	{
+		int x, y, w, h;
+		if(sscanf(args[i], "%d,%d,%d,%d", &x, &y, &w, &h) != 4)
+		{
+			std::cerr << "Bad clip: " << args[i] << std::endl;
+			return 1;
+		}
+		clips.push_back(x);
+		clips.push_back(y);
+		clips.push_back(w);
+		clips.push_back(h);
+	}
+
+	// No window is needed, only the image loader
+	if(SDL_Init(0) == -1)
+	{
+		return 2;
+	}
+
+	SDL_Surface *loadedImage = IMG_Load(args[1]);
+	if(loadedImage == NULL)
+	{
+		std::cerr << "Couldn't load " << args[1] << std::endl;
+		SDL_Quit();
+		return 3;
+	}
+
+	// Convert to the packed format, copying pixels straight rather than blending or keying them out
+	SDL_Surface *packed = SDL_CreateRGBSurface(SDL_SWSURFACE, loadedImage->w, loadedImage->h, SPRITE_BPP, SPRITE_RMASK, SPRITE_GMASK, SPRITE_BMASK, 0);
+	if(packed == NULL)
+	{
+		SDL_FreeSurface(loadedImage);
+		SDL_Quit();
+		return 4;
+	}
+	SDL_SetAlpha(loadedImage, 0, 0);
+	SDL_SetColorKey(loadedImage, 0, 0);
+	SDL_BlitSurface(loadedImage, NULL, packed, NULL);
+	SDL_FreeSurface(loadedImage);
+
+	// Fill in the header
+	SpriteHeader header;
+	memcpy(header.magic, SPRITE_MAGIC, sizeof(header.magic));
+	header.w = packed->w;
+	header.h = packed->h;
+	header.pitch = packed->w * 4;
+	header.bpp = SPRITE_BPP;
+	header.rMask = SPRITE_RMASK;
+	header.gMask = SPRITE_GMASK;
+	header.bMask = SPRITE_BMASK;
+	header.aMask = 0;
+	header.colorKey = SDL_MapRGB(packed->format, 0, 0xFF, 0xFF);
+	header.clipCount = clips.size() / 4;
+
+	// Line the pixels up so the mapped rows start aligned
+	Uint32 end = sizeof(header) + clips.size() * sizeof(Sint32);
+	header.pixelOffset = (end + SPRITE_ALIGN - 1) / SPRITE_ALIGN * SPRITE_ALIGN;
+
+	std::ofstream file(args[2], std::ios::binary);
+	if(file.fail() == true)
+	{
+		std::cerr << "Couldn't open " << args[2] << std::endl;
+		SDL_FreeSurface(packed);
+		SDL_Quit();
+		return 5;
+	}
+
+	// Write the header and clips, then pad up to the pixels
+	file.write((char *)&header, sizeof(header));
+	if(clips.empty() == false)
+	{
+		file.write((char *)&clips[0], clips.size() * sizeof(Sint32));
+	}
+	std::vector<char> padding(header.pixelOffset - end, 0);
+	if(padding.empty() == false)
+	{
+		file.write(&padding[0], padding.size());
+	}
+
+	// Write the pixels a row at a time, leaving out any padding in the surface's rows
+	if(SDL_MUSTLOCK(packed))
+	{
+		SDL_LockSurface(packed);
+	}
+	for(int y = 0; y < packed->h; y++)
+	{
+		file.write((char *)packed->pixels + y * packed->pitch, header.pitch);
+	}
+	if(SDL_MUSTLOCK(packed))
+	{
+		SDL_UnlockSurface(packed);
+	}
+
+	bool failed = file.fail();
+	file.close();
+
+	SDL_FreeSurface(packed);
+	SDL_Quit();
+
+	if(failed == true)
+	{
+		std::cerr << "Couldn't write " << args[2] << std::endl;
+		return 6;
+	}
+
+	return 0;
+}
@@ -4,17 +4,25 @@
 #include "SDL_image.h"
 #include "SDL_ttf.h"
 #include <string>
-#include <sstream>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <vector>
+#include <chrono>
 
 // Constants
 int const SCREEN_WIDTH = 640;
 int const SCREEN_HEIGHT = 480;
 int const SCREEN_BPP = 32;
 
+// The characters kept in a glyph atlas
+int const GLYPH_FIRST = 32;
+int const GLYPH_LAST = 126;
+int const GLYPH_COUNT = GLYPH_LAST - GLYPH_FIRST + 1;
+
 // Surfaces
 SDL_Surface *screen = NULL;
 SDL_Surface *background = NULL;
-SDL_Surface *seconds = NULL;
 SDL_Surface *startStop = NULL;
 
 // Font
@@ -26,8 +34,279 @@ SDL_Color textColor = {0xF0, 0xFF, 0xF0};
 // Event
 SDL_Event event;
 
+// Every printable character of a font rendered once into one surface, strings are drawn by blitting from it
+class GlyphAtlas
+{
+public:
+	GlyphAtlas();
+
+	// Renders the font's characters in the color into the atlas. Returns false if the atlas couldn't be made
+	bool build(TTF_Font *font, SDL_Color color);
+
+	// Frees the atlas surface
+	void clear();
+
+	// Width in pixels the string takes when drawn
+	int getWidth(const char *text);
+
+	// Draws the string with its top left at x, y
+	void draw(int x, int y, const char *text, SDL_Surface *destination);
+
+private:
+	// Index into the tables for a character, anything outside the atlas shows as '?'
+	int glyph(char c);
+
+	SDL_Surface *atlas;
+	// Where each glyph is in the atlas
+	SDL_Rect clips[GLYPH_COUNT];
+	// Where each glyph is drawn from the pen position
+	int xOffset[GLYPH_COUNT];
+	int yOffset[GLYPH_COUNT];
+	// How far each glyph moves the pen
+	int advance[GLYPH_COUNT];
+};
+
+// Atlas the timer's time is drawn from
+GlyphAtlas timeText;
+
+// Runs the main loop headless for a set number of frames and reports the frame rate
+class Benchmark
+{
+public:
+	Benchmark();
+
+	// Reads -frames N and -checksum from the command line
+	void parse(int argc, char *args[]);
+
+	// True if a benchmark was asked for
+	bool isRunning();
+
+	// Frames finished so far, shown in place of the clock so runs draw the same thing
+	int getFrame();
+
+	// Counts a finished frame and checksums it if asked. Returns false once all the frames are done
+	bool frameDone(SDL_Surface *surface);
+
+	// Prints the checksums and frame rate
+	void report();
+
+private:
+	int frames;
+	int done;
+	bool checksum;
+	// Checksum of each frame
+	std::vector<Uint32> sums;
+	// When the first frame finished
+	std::chrono::steady_clock::time_point startTime;
+};
+
 // Functions
 
+GlyphAtlas::GlyphAtlas()
+{
+	atlas = NULL;
+}
+
+// Renders each glyph once, lays them out left to right and copies them into one colorkeyed surface in the screen's format
+bool GlyphAtlas::build(TTF_Font *font, SDL_Color color)
+{
+	SDL_Surface *glyphs[GLYPH_COUNT];
+	int width = 0;
+	int height = 0;
+	int ascent = TTF_FontAscent(font);
+
+	for(int i = 0; i < GLYPH_COUNT; i++)
+	{
+		int minX, maxX, minY, maxY;
+		if(TTF_GlyphMetrics(font, GLYPH_FIRST + i, &minX, &maxX, &minY, &maxY, &advance[i]) == -1)
+		{
+			minX = 0;
+			maxY = 0;
+			advance[i] = 0;
+		}
+		xOffset[i] = minX;
+		yOffset[i] = ascent - maxY;
+
+		// Blank glyphs like space render to NULL
+		glyphs[i] = TTF_RenderGlyph_Solid(font, GLYPH_FIRST + i, color);
+
+		clips[i].x = width;
+		clips[i].y = 0;
+		clips[i].w = 0;
+		clips[i].h = 0;
+		if(glyphs[i] != NULL)
+		{
+			clips[i].w = glyphs[i]->w;
+			clips[i].h = glyphs[i]->h;
+			// 1 pixel gap so neighbours don't bleed
+			width += glyphs[i]->w + 1;
+			if(glyphs[i]->h > height)
+			{
+				height = glyphs[i]->h;
+			}
+		}
+	}
+
+	SDL_Surface *packed = SDL_CreateRGBSurface(SDL_SWSURFACE, width, height, SCREEN_BPP, 0, 0, 0, 0);
+	if(packed != NULL)
+	{
+		atlas = SDL_DisplayFormat(packed);
+		SDL_FreeSurface(packed);
+	}
+
+	if(atlas != NULL)
+	{
+		Uint32 key = SDL_MapRGB(atlas->format, 0, 0xFF, 0xFF);
+		SDL_FillRect(atlas, NULL, key);
+		for(int i = 0; i < GLYPH_COUNT; i++)
+		{
+			if(glyphs[i] != NULL)
+			{
+				SDL_Rect offset;
+				offset.x = clips[i].x;
+				offset.y = 0;
+				SDL_BlitSurface(glyphs[i], NULL, atlas, &offset);
+			}
+		}
+		SDL_SetColorKey(atlas, SDL_SRCCOLORKEY | SDL_RLEACCEL, key);
+	}
+
+	for(int i = 0; i < GLYPH_COUNT; i++)
+	{
+		SDL_FreeSurface(glyphs[i]);
+	}
+
+	return atlas != NULL;
+}
+
+void GlyphAtlas::clear()
+{
+	SDL_FreeSurface(atlas);
+	atlas = NULL;
+}
+
+int GlyphAtlas::glyph(char c)
+{
+	if((c < GLYPH_FIRST) || (c > GLYPH_LAST))
+	{
+		c = '?';
+	}
+	return c - GLYPH_FIRST;
+}
+
+int GlyphAtlas::getWidth(const char *text)
+{
+	int width = 0;
+	for(const char *c = text; *c != '\0'; c++)
+	{
+		width += advance[glyph(*c)];
+	}
+	return width;
+}
+
+void GlyphAtlas::draw(int x, int y, const char *text, SDL_Surface *destination)
+{
+	for(const char *c = text; *c != '\0'; c++)
+	{
+		int i = glyph(*c);
+		if(clips[i].w > 0)
+		{
+			SDL_Rect offset;
+			offset.x = x + xOffset[i];
+			offset.y = y + yOffset[i];
+			SDL_BlitSurface(atlas, &clips[i], destination, &offset);
+		}
+		// Move the pen on to the next glyph
+		x += advance[i];
+	}
+}
+
+Benchmark::Benchmark()
+{
+	frames = 0;
+	done = 0;
+	checksum = false;
+}
+
+void Benchmark::parse(int argc, char *args[])
+{
+	for(int i = 1; i < argc; i++)
+	{
+		if((strcmp(args[i], "-frames") == 0) && (i + 1 < argc))
+		{
+			frames = atoi(args[i + 1]);
+			i++;
+		}
+		else if(strcmp(args[i], "-checksum") == 0)
+		{
+			checksum = true;
+		}
+	}
+}
+
+bool Benchmark::isRunning()
+{
+	return frames > 0;
+}
+
+int Benchmark::getFrame()
+{
+	return done;
+}
+
+bool Benchmark::frameDone(SDL_Surface *surface)
+{
+	if(done == 0)
+	{
+		startTime = std::chrono::steady_clock::now();
+	}
+
+	if(checksum == true)
+	{
+		// FNV-1a over the visible pixels, row padding skipped
+		Uint32 sum = 2166136261u;
+		if(SDL_MUSTLOCK(surface))
+		{
+			SDL_LockSurface(surface);
+		}
+		int rowBytes = surface->w * surface->format->BytesPerPixel;
+		for(int y = 0; y < surface->h; y++)
+		{
+			Uint8 *row = (Uint8 *)surface->pixels + y * surface->pitch;
+			for(int x = 0; x < rowBytes; x++)
+			{
+				sum = (sum ^ row[x]) * 16777619u;
+			}
+		}
+		if(SDL_MUSTLOCK(surface))
+		{
+			SDL_UnlockSurface(surface);
+		}
+		sums.push_back(sum);
+	}
+
+	done++;
+	return done < frames;
+}
+
+void Benchmark::report()
+{
+	// Timed from the end of the first frame so loading isn't counted
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+
+	for(unsigned int i = 0; i < sums.size(); i++)
+	{
+		printf("frame %u checksum %08x\n", i, (unsigned)sums[i]);
+	}
+
+	printf("frames: %d time: %.3f ms", done, ms);
+	if((done > 1) && (ms > 0))
+	{
+		printf(" fps: %.1f", (done - 1) * 1000.0 / ms);
+	}
+	printf("\n");
+}
+
 // Loads image from filename arugment and returns as 32bit
 SDL_Surface *loadImage(std::string filename)
 {
@@ -103,6 +382,12 @@ bool loadFiles()
 		return false;
 	}
 
+	// Render the glyphs for the timer's time once up front
+	if(timeText.build(font, textColor) == false)
+	{
+		return false;
+	}
+
 	return true;
 }
 
@@ -111,6 +396,7 @@ void cleanUp()
 {
 	SDL_FreeSurface(background);
 	SDL_FreeSurface(startStop);
+	timeText.clear();
 	TTF_CloseFont(font);
 	TTF_Quit();
 	SDL_Quit();
@@ -120,6 +406,18 @@ int main(int arc, char* args[])
 {
 	// Quit flag
 	bool quit = false;
+
+	// Headless benchmark settings
+	Benchmark bench;
+	bench.parse(arc, args);
+
+	// A benchmark draws to an offscreen surface from the dummy video driver
+	if(bench.isRunning() == true)
+	{
+		// putenv may keep the string rather than copy it
+		static char dummyDriver[] = "SDL_VIDEODRIVER=dummy";
+		SDL_putenv(dummyDriver);
+	}
   
   // Closes program if any error occurs initializing
 	if(init() == false)
@@ -187,19 +485,19 @@ int main(int arc, char* args[])
 		if(running == true)
 		{
 			// The timer's time as a string
-			std::stringstream time;
+			char time[32];
 
 			// Conver the timer's time to a string
       // time = current time from GetTicks() - start time
-			time << "Timer: " << SDL_GetTicks() - start;
-
-			// Render the time surface
-			seconds = TTF_RenderText_Solid(font, time.str().c_str(), textColor);
-			// Apply the time surface
-			applySurface((SCREEN_WIDTH - seconds->w)/2, 50, seconds, screen);
+			Uint32 elapsed = SDL_GetTicks() - start;
+			if(bench.isRunning() == true)
+			{
+				elapsed = bench.getFrame();
+			}
+			snprintf(time, sizeof(time), "Timer: %u", (unsigned)elapsed);
 
-			// Free the time surface
-			SDL_FreeSurface(seconds);
+			// Draw the time from the glyph atlas
+			timeText.draw((SCREEN_WIDTH - timeText.getWidth(time))/2, 50, time, screen);
 		}
 
 		// Update the screen
@@ -207,6 +505,17 @@ int main(int arc, char* args[])
 		{
 			return 3;
 		}
+
+		// Stop once the benchmark's frames are done
+		if((bench.isRunning() == true) && (bench.frameDone(screen) == false))
+		{
+			quit = true;
+		}
+	}
+
+	if(bench.isRunning() == true)
+	{
+		bench.report();
 	}
 	cleanUp();
 	return 0;